@@ -0,0 +1,93 @@
+# Adds the MirrorU scalar parameter AFaceTracker sets on its video material, so the unmirrored
+# VideoTexture is shown mirrored without the face pipeline flipping any pixels.
+#
+# Runs on M_VideoDisplay, or on the material paths given as arguments:
+#   UnrealEditor-Cmd HonoursProject.uproject -run=pythonscript -script="Content/Python/add_video_mirror_parameter.py"
+#
+# The VideoTexture sample's UVs become lerp(UV, (1 - U, V), MirrorU). MirrorU defaults to 0, so
+# meshes using the material outside the tracker are unchanged.
+
+import sys
+
+import unreal
+
+DEFAULT_MATERIALS = ["/Game/EmotionBasedGaming/Materials/M_VideoDisplay"]
+TEXTURE_PARAMETER = "VideoTexture"
+MIRROR_PARAMETER = "MirrorU"
+
+MATERIAL_OUTPUTS = [
+    unreal.MaterialProperty.MP_EMISSIVE_COLOR,
+    unreal.MaterialProperty.MP_BASE_COLOR,
+]
+
+
+def find_video_sample(material):
+    lib = unreal.MaterialEditingLibrary
+    for output in MATERIAL_OUTPUTS:
+        node = lib.get_material_property_input_node(material, output)
+        if isinstance(node, unreal.MaterialExpressionTextureSampleParameter2D) and str(node.get_editor_property("parameter_name")) == TEXTURE_PARAMETER:
+            return node
+    return None
+
+
+def add_mirror_parameter(path):
+    lib = unreal.MaterialEditingLibrary
+    material = unreal.EditorAssetLibrary.load_asset(path)
+    if not isinstance(material, unreal.Material):
+        unreal.log_error("{}: not a material".format(path))
+        return False
+
+    if MIRROR_PARAMETER in [str(name) for name in lib.get_scalar_parameter_names(material)]:
+        unreal.log("{}: already has {}".format(path, MIRROR_PARAMETER))
+        return True
+
+    sample = find_video_sample(material)
+    if sample is None:
+        unreal.log_error("{}: no {} texture sample wired straight to Emissive or Base Color".format(path, TEXTURE_PARAMETER))
+        return False
+
+    x = sample.get_editor_property("material_expression_editor_x") - 900
+    y = sample.get_editor_property("material_expression_editor_y")
+
+    mirror = lib.create_material_expression(material, unreal.MaterialExpressionScalarParameter, x, y + 200)
+    mirror.set_editor_property("parameter_name", MIRROR_PARAMETER)
+    mirror.set_editor_property("default_value", 0.0)
+
+    uv = lib.create_material_expression(material, unreal.MaterialExpressionTextureCoordinate, x, y)
+
+    u = lib.create_material_expression(material, unreal.MaterialExpressionComponentMask, x + 200, y - 60)
+    u.set_editor_property("r", True)
+    lib.connect_material_expressions(uv, "", u, "")
+
+    v = lib.create_material_expression(material, unreal.MaterialExpressionComponentMask, x + 200, y + 60)
+    v.set_editor_property("g", True)
+    lib.connect_material_expressions(uv, "", v, "")
+
+    flipped_u = lib.create_material_expression(material, unreal.MaterialExpressionOneMinus, x + 400, y - 60)
+    lib.connect_material_expressions(u, "", flipped_u, "")
+
+    flipped_uv = lib.create_material_expression(material, unreal.MaterialExpressionAppendVector, x + 550, y)
+    lib.connect_material_expressions(flipped_u, "", flipped_uv, "A")
+    lib.connect_material_expressions(v, "", flipped_uv, "B")
+
+    mirrored_uv = lib.create_material_expression(material, unreal.MaterialExpressionLinearInterpolate, x + 700, y)
+    lib.connect_material_expressions(uv, "", mirrored_uv, "A")
+    lib.connect_material_expressions(flipped_uv, "", mirrored_uv, "B")
+    lib.connect_material_expressions(mirror, "", mirrored_uv, "Alpha")
+
+    lib.connect_material_expressions(mirrored_uv, "", sample, "UVs")
+
+    lib.recompile_material(material)
+    unreal.EditorAssetLibrary.save_loaded_asset(material)
+    unreal.log("{}: added {}".format(path, MIRROR_PARAMETER))
+    return True
+
+
+def main(paths):
+    results = [add_mirror_parameter(path) for path in (paths or DEFAULT_MATERIALS)]
+    return 0 if all(results) else 1
+
+
+if __name__ == "__main__":
+    if main(sys.argv[1:]) != 0:
+        unreal.log_error("Some materials weren't updated")
@@ -0,0 +1,154 @@
+
+#include "FaceAssociation.h"
+
+#include <algorithm>
+
+
+static float GetIoU(const cv::Rect& A, const cv::Rect& B)
+{
+    const int32 Intersection = (A & B).area();
+    const int32 Union = A.area() + B.area() - Intersection;
+    return Union > 0 ? (float)Intersection / Union : 0.0f;
+}
+
+static cv::Point2f GetCenter(const cv::Rect& Rect)
+{
+    return cv::Point2f(Rect.x + Rect.width * 0.5f, Rect.y + Rect.height * 0.5f);
+}
+
+FFaceAssociator::FFaceAssociator(const FFaceAssociationSettings& InSettings)
+{
+    SetSettings(InSettings);
+}
+
+void FFaceAssociator::SetSettings(const FFaceAssociationSettings& InSettings)
+{
+    Settings = InSettings;
+    Settings.MaxFaces = FMath::Max(Settings.MaxFaces, 1);
+    Settings.MaxMissedFrames = FMath::Max(Settings.MaxMissedFrames, 0);
+    Tracks.Reset();
+}
+
+void FFaceAssociator::Update(std::vector<cv::Rect>& Faces, TArray<int32>& OutFaceIds)
+{
+    // Largest faces first, so they win when new tracks are capped, and only as many as can ever be matched
+    std::sort(Faces.begin(), Faces.end(), [](const cv::Rect& A, const cv::Rect& B) { return A.area() > B.area(); });
+    if ((int32)Faces.size() > Settings.MaxFaces * 2)
+    {
+        Faces.resize(Settings.MaxFaces * 2);
+    }
+
+    const int32 NumFaces = Faces.size();
+    FaceTracks.Init(INDEX_NONE, NumFaces);
+    TrackMatched.Init(false, Tracks.Num());
+
+    // Score every plausible pairing against where each track should be by now
+    Candidates.Reset();
+    for (int32 TrackIndex = 0; TrackIndex < Tracks.Num(); TrackIndex++)
+    {
+        const FFaceTrack& Track = Tracks[TrackIndex];
+        const cv::Point2f Motion = Track.Velocity * (float)(Track.MissedFrames + 1);
+        const cv::Point2f PredictedCenter = GetCenter(Track.Rect) + Motion;
+        const cv::Rect PredictedRect = Track.Rect + cv::Point(FMath::RoundToInt(Motion.x), FMath::RoundToInt(Motion.y));
+
+        for (int32 FaceIndex = 0; FaceIndex < NumFaces; FaceIndex++)
+        {
+            const cv::Rect& Face = Faces[FaceIndex];
+            const float IoU = GetIoU(PredictedRect, Face);
+            const float Distance = (float)cv::norm(GetCenter(Face) - PredictedCenter) / FMath::Max(FMath::Max(Track.Rect.width, Face.width), 1);
+            if (IoU < Settings.MinIoU && Distance > Settings.MaxCentroidDistance)
+            {
+                continue;
+            }
+
+            const float Closeness = Settings.MaxCentroidDistance > 0.0f ? FMath::Max(0.0f, 1.0f - Distance / Settings.MaxCentroidDistance) : 0.0f;
+            Candidates.Add({ IoU + Settings.CentroidWeight * Closeness, TrackIndex, FaceIndex });
+        }
+    }
+
+    Candidates.Sort([](const FCandidate& A, const FCandidate& B) { return A.Score > B.Score; });
+
+    int32 NumVisible = 0;
+    for (const FCandidate& Candidate : Candidates)
+    {
+        if (TrackMatched[Candidate.Track] || FaceTracks[Candidate.Face] != INDEX_NONE)
+        {
+            continue;
+        }
+        TrackMatched[Candidate.Track] = true;
+        FaceTracks[Candidate.Face] = Candidate.Track;
+        NumVisible++;
+
+        // Blend the observed motion into the velocity, spread over the frames the face was missing
+        FFaceTrack& Track = Tracks[Candidate.Track];
+        const cv::Rect& Face = Faces[Candidate.Face];
+        const cv::Point2f Motion = (GetCenter(Face) - GetCenter(Track.Rect)) * (1.0f / (Track.MissedFrames + 1));
+        Track.Velocity = (Track.Velocity + Motion) * 0.5f;
+        Track.Rect = Face;
+        Track.MissedFrames = 0;
+    }
+
+    for (int32 TrackIndex = 0; TrackIndex < Tracks.Num(); TrackIndex++)
+    {
+        if (!TrackMatched[TrackIndex])
+        {
+            Tracks[TrackIndex].MissedFrames++;
+        }
+    }
+
+    // Unmatched faces are new arrivals
+    for (int32 FaceIndex = 0; FaceIndex < NumFaces && NumVisible < Settings.MaxFaces; FaceIndex++)
+    {
+        if (FaceTracks[FaceIndex] == INDEX_NONE)
+        {
+            FFaceTrack& Track = Tracks.AddDefaulted_GetRef();
+            Track.Id = NextFaceId++;
+            Track.Rect = Faces[FaceIndex];
+            NumVisible++;
+        }
+    }
+
+    // Report visible tracks oldest first, so the first face stays the first face
+    Faces.clear();
+    OutFaceIds.Reset();
+    for (FFaceTrack& Track : Tracks)
+    {
+        if (Track.MissedFrames == 0)
+        {
+            if ((int32)Faces.size() < Settings.MaxFaces)
+            {
+                Faces.push_back(Track.Rect);
+                OutFaceIds.Add(Track.Id);
+            }
+            else
+            {
+                // A lost track came back while MaxFaces others were in view
+                Track.MissedFrames = 1;
+            }
+        }
+    }
+
+    // Retire faces gone too long, and the longest missing ones beyond MaxFaces lost tracks
+    Tracks.RemoveAll([this](const FFaceTrack& Track) { return Track.MissedFrames > Settings.MaxMissedFrames; });
+    for (;;)
+    {
+        int32 NumLost = 0;
+        int32 LongestMissing = INDEX_NONE;
+        for (int32 TrackIndex = 0; TrackIndex < Tracks.Num(); TrackIndex++)
+        {
+            if (Tracks[TrackIndex].MissedFrames > 0)
+            {
+                NumLost++;
+                if (LongestMissing == INDEX_NONE || Tracks[TrackIndex].MissedFrames > Tracks[LongestMissing].MissedFrames)
+                {
+                    LongestMissing = TrackIndex;
+                }
+            }
+        }
+        if (NumLost <= Settings.MaxFaces)
+        {
+            break;
+        }
+        Tracks.RemoveAt(LongestMissing);
+    }
+}
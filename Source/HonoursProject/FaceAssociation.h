@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PreOpenCVHeaders.h"
+#include "opencv2/core.hpp"
+#include "PostOpenCVHeaders.h"
+
+#include "FaceAssociation.generated.h"
+
+
+USTRUCT(BlueprintType)
+struct FFaceAssociationSettings
+{
+	GENERATED_BODY()
+
+	// Faces reported per frame, extra detections are dropped smallest first
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Association", meta = (ClampMin = 1, ClampMax = 8))
+	int32 MaxFaces = 4;
+
+	// Overlap with a track's predicted rect that is enough to match on its own
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Association", meta = (ClampMin = 0, ClampMax = 1))
+	float MinIoU = 0.1f;
+
+	// Furthest a face can move between matches and keep its ID, in face widths
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Association", meta = (ClampMin = 0))
+	float MaxCentroidDistance = 0.75f;
+
+	// Weight of centroid closeness against IoU when several pairings compete
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Association", meta = (ClampMin = 0))
+	float CentroidWeight = 0.5f;
+
+	// Frames a face can go undetected, e.g. turned away or behind a hand, before its ID is retired
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Association", meta = (ClampMin = 0, ClampMax = 300))
+	int32 MaxMissedFrames = 15;
+};
+
+
+// Matches each frame's face rects to persistent tracks so every face keeps its ID while it stays in view.
+// Pairs are scored by IoU plus centroid closeness against a constant-velocity prediction and assigned
+// greedily, best score first. At most MaxFaces visible and MaxFaces lost tracks are kept, so a frame
+// costs at most 4 * MaxFaces^2 pair scores however many rects the detector returns.
+class FFaceAssociator
+{
+public:
+	explicit FFaceAssociator(const FFaceAssociationSettings& InSettings = FFaceAssociationSettings());
+
+	// Forgets all tracks
+	void SetSettings(const FFaceAssociationSettings& InSettings);
+	const FFaceAssociationSettings& GetSettings() const { return Settings; }
+
+	// Reorders Faces oldest track first and trims it to MaxFaces, OutFaceIds gets the ID of each remaining face
+	void Update(std::vector<cv::Rect>& Faces, TArray<int32>& OutFaceIds);
+
+private:
+	struct FFaceTrack
+	{
+		int32 Id = 0;
+		cv::Rect Rect;
+		// Centroid motion per frame
+		cv::Point2f Velocity = cv::Point2f(0.0f, 0.0f);
+		int32 MissedFrames = 0;
+	};
+
+	struct FCandidate
+	{
+		float Score;
+		int32 Track;
+		int32 Face;
+	};
+
+	FFaceAssociationSettings Settings;
+	// Oldest first, IDs are never reused
+	TArray<FFaceTrack> Tracks;
+	int32 NextFaceId = 1;
+
+	// Per-frame scratch, kept to avoid allocating every frame
+	TArray<FCandidate> Candidates;
+	TArray<int32> FaceTracks;
+	TArray<bool> TrackMatched;
+};
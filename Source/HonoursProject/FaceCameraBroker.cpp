@@ -0,0 +1,413 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FaceCameraBroker.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformProcess.h"
+#include "Async/Async.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+
+static TAutoConsoleVariable<float> CVarFaceTrackerCameraIdleClose(
+    TEXT("FaceTracker.Camera.IdleCloseSeconds"),
+    5.0f,
+    TEXT("How long a webcam stays open without subscribers, long enough to cover a level transition"));
+
+static TAutoConsoleVariable<float> CVarFaceTrackerCameraMaxRetryDelay(
+    TEXT("FaceTracker.Camera.MaxRetryDelay"),
+    10.0f,
+    TEXT("Longest wait between attempts to reopen a lost webcam, in seconds. The wait doubles from 0.5 s up to this"));
+
+// Longest a subscriber waits for a frame, so a stalled camera can't hold up a worker that is shutting down
+static constexpr uint32 MaxFrameWaitMs = 500;
+
+// Consecutive failed reads before the device counts as lost
+static constexpr int32 MaxReadFailures = 5;
+
+static constexpr float MinRetryDelay = 0.5f;
+
+static const TCHAR* GetCameraStateName(EFaceCameraState State)
+{
+    switch (State)
+    {
+        case EFaceCameraState::Opening:
+            return TEXT("Opening");
+        case EFaceCameraState::Streaming:
+            return TEXT("Streaming");
+        case EFaceCameraState::Lost:
+            return TEXT("Lost");
+        case EFaceCameraState::Reopening:
+            return TEXT("Reopening");
+        default:
+            return TEXT("Closed");
+    }
+}
+
+FFaceCameraBroker::FFaceCameraBroker(int32 InCameraIndex, FIntPoint InRequestedSize, float InRequestedFrameRate, EFaceCameraFormat InRequestedFormat,
+    FStateChangedCallback InOnStateChanged)
+: CameraIndex(InCameraIndex)
+, RequestedSize(InRequestedSize)
+, RequestedFrameRate(InRequestedFrameRate)
+, RequestedFormat(InRequestedFormat)
+, Camera(InCameraIndex, InRequestedSize, InRequestedFrameRate, InRequestedFormat)
+, OnStateChanged(MoveTemp(InOnStateChanged))
+, bRunning(true)
+, WakeEvent(FPlatformProcess::GetSynchEventFromPool(false))
+, StopEvent(FPlatformProcess::GetSynchEventFromPool(true))
+{
+}
+
+FFaceCameraBroker::~FFaceCameraBroker()
+{
+    // Shutdown hands the thread off while it holds a reference, so it is only still here if Shutdown never ran
+    Stop();
+    if (Thread)
+    {
+        Thread->WaitForCompletion();
+        delete Thread;
+        Thread = nullptr;
+    }
+    
+    FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+    FPlatformProcess::ReturnSynchEventToPool(StopEvent);
+}
+
+bool FFaceCameraBroker::AddSubscriber(FEvent* FrameEvent)
+{
+    FScopeLock ScopeLock(&Lock);
+    
+    if (!bRunning)
+    {
+        return false;
+    }
+    
+    SubscriberEvents.AddUnique(FrameEvent);
+    
+    if (!Thread)
+    {
+        Thread = FRunnableThread::Create(this, *FString::Printf(TEXT("FaceCamera%d"), CameraIndex), 0, TPri_AboveNormal);
+    }
+    
+    // A closed camera starts opening straight away rather than on the next poll
+    WakeEvent->Trigger();
+    return true;
+}
+
+void FFaceCameraBroker::RemoveSubscriber(FEvent* FrameEvent)
+{
+    FScopeLock ScopeLock(&Lock);
+    
+    SubscriberEvents.Remove(FrameEvent);
+    if (SubscriberEvents.Num() == 0)
+    {
+        IdleSince = FPlatformTime::Seconds();
+    }
+}
+
+void FFaceCameraBroker::Shutdown()
+{
+    Stop();
+    
+    FRunnableThread* ExitingThread = nullptr;
+    {
+        FScopeLock ScopeLock(&Lock);
+        ExitingThread = Thread;
+        Thread = nullptr;
+        LatestFrame.Reset();
+        
+        // Wake anyone still waiting so they see the camera has gone
+        NotifySubscribers();
+    }
+    
+    // A read or open in progress can block for seconds on V4L2, so it is waited out off the caller's thread.
+    // The device is closed on the capture thread on its way out
+    if (ExitingThread)
+    {
+        Async(EAsyncExecution::Thread, [Broker = AsShared(), ExitingThread]()
+        {
+            ExitingThread->WaitForCompletion();
+            delete ExitingThread;
+        });
+    }
+}
+
+FFaceCameraFramePtr FFaceCameraBroker::GetLatestFrame() const
+{
+    FScopeLock ScopeLock(&Lock);
+    return LatestFrame;
+}
+
+EFaceCameraState FFaceCameraBroker::GetState() const
+{
+    FScopeLock ScopeLock(&Lock);
+    return State;
+}
+
+FIntPoint FFaceCameraBroker::GetFrameSize() const
+{
+    FScopeLock ScopeLock(&Lock);
+    return FrameSize;
+}
+
+float FFaceCameraBroker::GetFrameRate() const
+{
+    FScopeLock ScopeLock(&Lock);
+    return FrameRate;
+}
+
+FString FFaceCameraBroker::GetDescription() const
+{
+    FScopeLock ScopeLock(&Lock);
+    return Description.IsEmpty() ? FString::Printf(TEXT("Webcam %d"), CameraIndex) : Description;
+}
+
+uint32 FFaceCameraBroker::Run()
+{
+    while (bRunning)
+    {
+        switch (GetState())
+        {
+            case EFaceCameraState::Closed:
+                TickClosed();
+                break;
+            case EFaceCameraState::Opening:
+            case EFaceCameraState::Reopening:
+                TickOpening();
+                break;
+            case EFaceCameraState::Streaming:
+                TickStreaming();
+                break;
+            case EFaceCameraState::Lost:
+                TickLost();
+                break;
+        }
+    }
+    
+    CloseCamera();
+    SetState(EFaceCameraState::Closed);
+    return 0;
+}
+
+void FFaceCameraBroker::Stop()
+{
+    bRunning = false;
+    WakeEvent->Trigger();
+    StopEvent->Trigger();
+}
+
+void FFaceCameraBroker::SetState(EFaceCameraState NewState)
+{
+    {
+        FScopeLock ScopeLock(&Lock);
+        if (State == NewState)
+        {
+            return;
+        }
+        State = NewState;
+    }
+    
+    UE_LOG(LogTemp, Log, TEXT("Webcam %d: %s"), CameraIndex, GetCameraStateName(NewState));
+    if (OnStateChanged)
+    {
+        OnStateChanged(NewState);
+    }
+}
+
+void FFaceCameraBroker::TickClosed()
+{
+    bool bHasSubscribers;
+    {
+        FScopeLock ScopeLock(&Lock);
+        bHasSubscribers = SubscriberEvents.Num() > 0;
+    }
+    
+    if (bHasSubscribers)
+    {
+        RetryDelay = MinRetryDelay;
+        SetState(EFaceCameraState::Opening);
+        return;
+    }
+    
+    // Woken by the next subscriber or Shutdown
+    WakeEvent->Wait();
+}
+
+void FFaceCameraBroker::TickOpening()
+{
+    // This is the call that can block for seconds on V4L2, which is why it lives on this thread
+    bool bOpened;
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(FaceTracker_CameraOpen);
+        bOpened = Camera.Open();
+    }
+    
+    if (!bOpened)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Failed to open webcam %d, retrying in %.1f s"), CameraIndex, RetryDelay);
+        CloseCamera();
+        SetState(EFaceCameraState::Lost);
+        return;
+    }
+    
+    {
+        FScopeLock ScopeLock(&Lock);
+        FrameSize = Camera.GetFrameSize();
+        FrameRate = Camera.GetFrameRate();
+        Description = Camera.GetDescription();
+    }
+    UE_LOG(LogTemp, Log, TEXT("%s opened: %dx%d @ %.1f FPS"), *Description, FrameSize.X, FrameSize.Y, FrameRate);
+    
+    // Camera asks for the size of the last open again, but a different device on the same index may not offer it.
+    // Subscribers compare GetFrameSize with their own and restart on a change
+    
+    ReadFailures = 0;
+    RetryDelay = MinRetryDelay;
+    SetState(EFaceCameraState::Streaming);
+}
+
+void FFaceCameraBroker::TickStreaming()
+{
+    {
+        FScopeLock ScopeLock(&Lock);
+        if (SubscriberEvents.Num() == 0 && FPlatformTime::Seconds() - IdleSince > CVarFaceTrackerCameraIdleClose.GetValueOnAnyThread())
+        {
+            ScopeLock.Unlock();
+            CloseCamera();
+            SetState(EFaceCameraState::Closed);
+            return;
+        }
+    }
+    
+    // Always a new buffer, the previous frame may still be held by subscribers
+    TSharedPtr<FFaceCameraFrame, ESPMode::ThreadSafe> Frame = MakeShared<FFaceCameraFrame, ESPMode::ThreadSafe>();
+    {
+        TRACE_CPUPROFILER_EVENT_SCOPE(FaceTracker_CameraRead);
+        if (!Camera.IsOpen() || !Camera.ReadFrame(Frame->Image) || Frame->Image.empty())
+        {
+            // An unplugged camera fails every read, a busy one only now and then
+            if (++ReadFailures >= MaxReadFailures || !Camera.IsOpen())
+            {
+                UE_LOG(LogTemp, Warning, TEXT("Webcam %d stopped delivering frames, reconnecting in %.1f s"), CameraIndex, RetryDelay);
+                CloseCamera();
+                SetState(EFaceCameraState::Lost);
+            }
+            else
+            {
+                FPlatformProcess::Sleep(0.005f);
+            }
+            return;
+        }
+    }
+    ReadFailures = 0;
+    Frame->Format = Camera.GetFrameFormat();
+    Frame->Time = Camera.GetFrameTime();
+    
+    FScopeLock ScopeLock(&Lock);
+    Frame->Sequence = NextSequence++;
+    LatestFrame = Frame;
+    NotifySubscribers();
+}
+
+void FFaceCameraBroker::TickLost()
+{
+    // Interrupted by Shutdown, not by new subscribers, the device is what's missing
+    StopEvent->Wait(FMath::CeilToInt32(RetryDelay * 1000.0f));
+    RetryDelay = FMath::Min(RetryDelay * 2.0f, FMath::Max(CVarFaceTrackerCameraMaxRetryDelay.GetValueOnAnyThread(), MinRetryDelay));
+    if (!bRunning)
+    {
+        return;
+    }
+    
+    bool bHasSubscribers;
+    {
+        FScopeLock ScopeLock(&Lock);
+        bHasSubscribers = SubscriberEvents.Num() > 0;
+    }
+    SetState(bHasSubscribers ? EFaceCameraState::Reopening : EFaceCameraState::Closed);
+}
+
+void FFaceCameraBroker::CloseCamera()
+{
+    Camera.Close();
+    
+    FScopeLock ScopeLock(&Lock);
+    LatestFrame.Reset();
+}
+
+void FFaceCameraBroker::NotifySubscribers()
+{
+    for (FEvent* FrameEvent : SubscriberEvents)
+    {
+        FrameEvent->Trigger();
+    }
+}
+
+FFaceCameraSubscription::FFaceCameraSubscription(FFaceCameraBrokerRef InBroker)
+: Broker(InBroker)
+, FrameEvent(FPlatformProcess::GetSynchEventFromPool(false))
+{
+}
+
+FFaceCameraSubscription::~FFaceCameraSubscription()
+{
+    Close();
+    FPlatformProcess::ReturnSynchEventToPool(FrameEvent);
+}
+
+bool FFaceCameraSubscription::Open()
+{
+    if (!bSubscribed)
+    {
+        bSubscribed = Broker->AddSubscriber(FrameEvent);
+    }
+    return bSubscribed;
+}
+
+void FFaceCameraSubscription::Close()
+{
+    if (bSubscribed)
+    {
+        Broker->RemoveSubscriber(FrameEvent);
+        bSubscribed = false;
+    }
+}
+
+bool FFaceCameraSubscription::IsOpen() const
+{
+    // Stays open through Opening, Lost and Reopening, ReadFrame waits on the broker rather than the caller polling
+    return bSubscribed && !Broker->IsShutDown();
+}
+
+bool FFaceCameraSubscription::ReadFrame(cv::Mat& OutFrame)
+{
+    const double WaitEnd = FPlatformTime::Seconds() + MaxFrameWaitMs / 1000.0;
+    while (bSubscribed && !bReadCancelled.exchange(false))
+    {
+        FFaceCameraFramePtr Frame = Broker->GetLatestFrame();
+        if (Frame && Frame->Sequence > LastSequence)
+        {
+            // Shares the broker's buffer, nothing downstream writes to the captured frame
+            OutFrame = Frame->Image;
+            FrameFormat = Frame->Format;
+            FrameTime = Frame->Time;
+            LastSequence = Frame->Sequence;
+            return true;
+        }
+        
+        // While the camera is reconnecting this sleeps out the whole timeout, so the caller doesn't spin
+        const double Now = FPlatformTime::Seconds();
+        if (Now >= WaitEnd || Broker->IsShutDown())
+        {
+            break;
+        }
+        FrameEvent->Wait(FMath::CeilToInt32((WaitEnd - Now) * 1000.0));
+    }
+    
+    return false;
+}
+
+void FFaceCameraSubscription::CancelRead()
+{
+    bReadCancelled = true;
+    FrameEvent->Trigger();
+}
@@ -0,0 +1,150 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/CriticalSection.h"
+
+#include <atomic>
+
+#include "FaceFrameSource.h"
+
+
+// One camera frame. Immutable once published, every subscriber reads the same pixels
+struct FFaceCameraFrame
+{
+	cv::Mat Image;
+	EFaceFrameFormat Format = EFaceFrameFormat::Bgr;
+	// Seconds since the camera was opened
+	double Time = 0.0;
+	// Increases by one per frame read
+	int64 Sequence = 0;
+};
+
+typedef TSharedPtr<const FFaceCameraFrame, ESPMode::ThreadSafe> FFaceCameraFramePtr;
+
+
+// Owns a webcam and runs its whole lifecycle on its own thread, publishing each frame to every subscriber.
+// Opening, reading and reconnecting the device never happen on the caller's thread: the first subscriber
+// starts an open in the background, a camera that fails to open or stops delivering is retried with
+// exponential backoff, and the device is closed once it has had no subscribers for FaceTracker.Camera.IdleCloseSeconds,
+// so a tracker respawned by a level transition picks the camera up again without reopening it
+class FFaceCameraBroker : public FRunnable, public TSharedFromThis<FFaceCameraBroker, ESPMode::ThreadSafe>
+{
+public:
+	// Called on the capture thread on every state change
+	typedef TFunction<void(EFaceCameraState)> FStateChangedCallback;
+
+	FFaceCameraBroker(int32 InCameraIndex, FIntPoint InRequestedSize, float InRequestedFrameRate, EFaceCameraFormat InRequestedFormat,
+		FStateChangedCallback InOnStateChanged);
+	virtual ~FFaceCameraBroker();
+
+	// Signal FrameEvent on every new frame. Never blocks on the device, returns false after Shutdown
+	bool AddSubscriber(FEvent* FrameEvent);
+	void RemoveSubscriber(FEvent* FrameEvent);
+
+	// Stop the capture thread for good without waiting for it. A read or open in progress finishes on a
+	// background thread, which closes the device and keeps the broker alive until then
+	void Shutdown();
+
+	// Null before the first frame
+	FFaceCameraFramePtr GetLatestFrame() const;
+
+	EFaceCameraState GetState() const;
+	bool IsShutDown() const { return !bRunning; }
+
+	// Valid once the camera has streamed
+	FIntPoint GetFrameSize() const;
+	float GetFrameRate() const;
+	FString GetDescription() const;
+	int32 GetCameraIndex() const { return CameraIndex; }
+
+	// What the broker was created with, the device may deliver something else
+	FIntPoint GetRequestedSize() const { return RequestedSize; }
+	float GetRequestedFrameRate() const { return RequestedFrameRate; }
+	EFaceCameraFormat GetRequestedFormat() const { return RequestedFormat; }
+
+	// FRunnable interface
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	int32 CameraIndex;
+	FIntPoint RequestedSize;
+	float RequestedFrameRate;
+	EFaceCameraFormat RequestedFormat;
+	// Only touched by the capture thread once it has started
+	FCameraFrameSource Camera;
+	FStateChangedCallback OnStateChanged;
+
+	// Guards everything below
+	mutable FCriticalSection Lock;
+	EFaceCameraState State = EFaceCameraState::Closed;
+	FFaceCameraFramePtr LatestFrame;
+	TArray<FEvent*> SubscriberEvents;
+	double IdleSince = 0.0;
+	int64 NextSequence = 0;
+	// Copied from the device after each successful open
+	FIntPoint FrameSize = FIntPoint::ZeroValue;
+	float FrameRate = 0.0f;
+	FString Description;
+
+	// Capture thread state
+	float RetryDelay = 0.0f;
+	int32 ReadFailures = 0;
+
+	FThreadSafeBool bRunning;
+	// New subscribers and Shutdown wake a closed camera, only Shutdown cuts a reconnect backoff short
+	FEvent* WakeEvent;
+	FEvent* StopEvent;
+	FRunnableThread* Thread = nullptr;
+
+	void SetState(EFaceCameraState NewState);
+	void TickClosed();
+	void TickOpening();
+	void TickStreaming();
+	void TickLost();
+	void CloseCamera();
+	void NotifySubscribers();
+};
+
+typedef TSharedRef<FFaceCameraBroker, ESPMode::ThreadSafe> FFaceCameraBrokerRef;
+
+
+// One consumer of a broker, usable anywhere a frame source is. Frames are shared with the other subscribers
+// and must not be written to. ReadFrame waits for a frame newer than the last one it returned
+class FFaceCameraSubscription : public IFaceFrameSource
+{
+public:
+	explicit FFaceCameraSubscription(FFaceCameraBrokerRef InBroker);
+	virtual ~FFaceCameraSubscription();
+
+	// Subscribe and unsubscribe without waiting, the broker opens and closes the device in the background
+	virtual bool Open() override;
+	virtual void Close() override;
+	virtual bool IsOpen() const override;
+	virtual bool IsStreaming() const override { return bSubscribed && Broker->GetState() == EFaceCameraState::Streaming; }
+	// Returns false if no frame arrives within a short timeout, e.g. while the camera is reconnecting
+	virtual bool ReadFrame(cv::Mat& OutFrame) override;
+	virtual void CancelRead() override;
+	// Only the latest frame is kept, nothing queues up behind a slow subscriber
+	virtual int32 DropStaleFrames(int32 MaxFrames) override { return 0; }
+	virtual double GetFrameTime() const override { return FrameTime; }
+	virtual FIntPoint GetFrameSize() const override { return Broker->GetFrameSize(); }
+	virtual float GetFrameRate() const override { return Broker->GetFrameRate(); }
+	virtual EFaceFrameFormat GetFrameFormat() const override { return FrameFormat; }
+	virtual FString GetDescription() const override { return Broker->GetDescription(); }
+
+	EFaceCameraState GetState() const { return Broker->GetState(); }
+
+private:
+	FFaceCameraBrokerRef Broker;
+	FEvent* FrameEvent;
+	std::atomic<bool> bReadCancelled{false};
+	bool bSubscribed = false;
+	int64 LastSequence = -1;
+	double FrameTime = 0.0;
+	EFaceFrameFormat FrameFormat = EFaceFrameFormat::Bgr;
+};
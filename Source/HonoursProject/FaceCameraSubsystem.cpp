@@ -0,0 +1,68 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FaceCameraSubsystem.h"
+#include "Async/Async.h"
+
+
+void UFaceCameraSubsystem::Deinitialize()
+{
+    // Subscriptions that outlive the game instance keep their broker alive, but see a closed camera.
+    // Never waits on the device, a capture thread still inside an open or read is reaped in the background
+    for (const TPair<int32, TSharedPtr<FFaceCameraBroker, ESPMode::ThreadSafe>>& Broker : Brokers)
+    {
+        Broker.Value->Shutdown();
+    }
+    Brokers.Empty();
+    
+    Super::Deinitialize();
+}
+
+TUniquePtr<IFaceFrameSource> UFaceCameraSubsystem::Subscribe(const FFaceFrameSourceSettings& Settings, FIntPoint RequestedSize, float RequestedFrameRate)
+{
+    check(IsInGameThread());
+    
+    TSharedPtr<FFaceCameraBroker, ESPMode::ThreadSafe>& Broker = Brokers.FindOrAdd(Settings.CameraIndex);
+    if (!Broker)
+    {
+        // State changes come from the capture thread, Blueprint only ever sees them on the game thread
+        TWeakObjectPtr<UFaceCameraSubsystem> WeakThis(this);
+        const int32 CameraIndex = Settings.CameraIndex;
+        Broker = MakeShared<FFaceCameraBroker, ESPMode::ThreadSafe>(CameraIndex, RequestedSize, RequestedFrameRate, Settings.CameraFormat,
+            [WeakThis, CameraIndex](EFaceCameraState State)
+            {
+                AsyncTask(ENamedThreads::GameThread, [WeakThis, CameraIndex, State]()
+                {
+                    if (UFaceCameraSubsystem* Subsystem = WeakThis.Get())
+                    {
+                        Subsystem->OnCameraStateChanged.Broadcast(CameraIndex, State);
+                    }
+                });
+            });
+    }
+    else if (Broker->GetRequestedSize() != RequestedSize || Broker->GetRequestedFrameRate() != RequestedFrameRate
+        || Broker->GetRequestedFormat() != Settings.CameraFormat)
+    {
+        const UEnum* FormatEnum = StaticEnum<EFaceCameraFormat>();
+        UE_LOG(LogTemp, Warning, TEXT("Camera %d was first requested at %dx%d @ %.1f FPS %s, ignoring the request for %dx%d @ %.1f FPS %s"),
+            Settings.CameraIndex,
+            Broker->GetRequestedSize().X, Broker->GetRequestedSize().Y, Broker->GetRequestedFrameRate(),
+            *FormatEnum->GetNameStringByValue((int64)Broker->GetRequestedFormat()),
+            RequestedSize.X, RequestedSize.Y, RequestedFrameRate,
+            *FormatEnum->GetNameStringByValue((int64)Settings.CameraFormat));
+    }
+    
+    return MakeUnique<FFaceCameraSubscription>(Broker.ToSharedRef());
+}
+
+FFaceCameraFramePtr UFaceCameraSubsystem::GetLatestFrame(int32 CameraIndex) const
+{
+    const TSharedPtr<FFaceCameraBroker, ESPMode::ThreadSafe>* Broker = Brokers.Find(CameraIndex);
+    return Broker ? (*Broker)->GetLatestFrame() : nullptr;
+}
+
+EFaceCameraState UFaceCameraSubsystem::GetCameraState(int32 CameraIndex) const
+{
+    const TSharedPtr<FFaceCameraBroker, ESPMode::ThreadSafe>* Broker = Brokers.Find(CameraIndex);
+    return Broker ? (*Broker)->GetState() : EFaceCameraState::Closed;
+}
@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+
+#include "FaceCameraBroker.h"
+
+#include "FaceCameraSubsystem.generated.h"
+
+
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnFaceCameraStateChanged, int32 /*CameraIndex*/, EFaceCameraState /*State*/);
+
+
+// Keeps one broker per webcam for the lifetime of the game instance, so level transitions don't reopen the device
+// and several trackers, or any other consumer, share its frames instead of fighting over it
+UCLASS()
+class HONOURSPROJECT_API UFaceCameraSubsystem : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	// A new subscription to the settings' webcam, not yet opened. The first subscriber's size, rate and format win,
+	// later requests that differ are logged and otherwise ignored. The subscription's GetFrameSize, GetFrameRate
+	// and GetFrameFormat report what the camera actually delivers
+	TUniquePtr<IFaceFrameSource> Subscribe(const FFaceFrameSourceSettings& Settings, FIntPoint RequestedSize, float RequestedFrameRate);
+
+	// Latest frame of a webcam that is already open, for consumers that only sample now and then. Null otherwise
+	FFaceCameraFramePtr GetLatestFrame(int32 CameraIndex) const;
+
+	// Closed for webcams nobody has subscribed to
+	UFUNCTION(BlueprintPure, Category = "Facial Tracking")
+	EFaceCameraState GetCameraState(int32 CameraIndex) const;
+
+	// Broadcast on the game thread, in order, for every state change of every webcam
+	FOnFaceCameraStateChanged OnCameraStateChanged;
+
+private:
+	TMap<int32, TSharedPtr<FFaceCameraBroker, ESPMode::ThreadSafe>> Brokers;
+};
@@ -0,0 +1,147 @@
+
+#include "FaceDetector.h"
+#include "Misc/Paths.h"
+
+
+cv::dnn::Net LoadDnnNet(const FString& ModelPath, const FString& ConfigPath, const TCHAR* ModelName)
+{
+    cv::dnn::Net Net;
+    if (!FPaths::FileExists(ModelPath) || (!ConfigPath.IsEmpty() && !FPaths::FileExists(ConfigPath)))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to load %s from: %s"), ModelName, *ModelPath);
+        return Net;
+    }
+
+    try
+    {
+        Net = cv::dnn::readNet(std::string(TCHAR_TO_UTF8(*ModelPath)), std::string(TCHAR_TO_UTF8(*ConfigPath)));
+    }
+    catch (const cv::Exception& Exception)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to load %s from: %s (%s)"), ModelName, *ModelPath, UTF8_TO_TCHAR(Exception.what()));
+        return cv::dnn::Net();
+    }
+
+    if (Net.empty())
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to load %s from: %s"), ModelName, *ModelPath);
+        return Net;
+    }
+
+    Net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+    Net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+    return Net;
+}
+
+TUniquePtr<IFaceDetector> IFaceDetector::Create(const FFaceDetectorConfig& Config)
+{
+    switch (Config.Backend)
+    {
+        case EFaceDetectorBackend::DnnSsd:
+            return MakeUnique<FDnnFaceDetector>(Config.DnnModelPath, Config.DnnConfigPath, Config.DnnConfidenceThreshold, Config.DnnInputSize);
+        default:
+            return MakeUnique<FHaarFaceDetector>(Config.HaarCascadePath);
+    }
+}
+
+FHaarFaceDetector::FHaarFaceDetector(const FString& InCascadePath)
+: CascadePath(InCascadePath)
+{
+}
+
+bool FHaarFaceDetector::Load()
+{
+    std::string CascadePathStr(TCHAR_TO_UTF8(*CascadePath));
+    if (!Cascade.load(CascadePathStr))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to load Face Cascade from: %s"), *CascadePath);
+        return false;
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("Face Cascade loaded successfully"));
+    return true;
+}
+
+void FHaarFaceDetector::Detect(const cv::Mat& Image, const FFaceQualityLevel& Quality, cv::Size MinSize, cv::Size MaxSize, std::vector<cv::Rect>& OutFaces)
+{
+    Cascade.detectMultiScale(Image, OutFaces, Quality.ScaleFactor, Quality.MinNeighbors, 0, MinSize, MaxSize);
+}
+
+FString FHaarFaceDetector::GetDescription() const
+{
+    return FString::Printf(TEXT("Haar cascade %s"), *FPaths::GetCleanFilename(CascadePath));
+}
+
+FDnnFaceDetector::FDnnFaceDetector(const FString& InModelPath, const FString& InConfigPath, float InConfidenceThreshold, int32 InInputSize)
+: ModelPath(InModelPath)
+, ConfigPath(InConfigPath)
+, ConfidenceThreshold(InConfidenceThreshold)
+, InputSize(FMath::Max(InInputSize, 32))
+{
+}
+
+bool FDnnFaceDetector::Load()
+{
+    Net = LoadDnnNet(ModelPath, ConfigPath, TEXT("DNN face detector"));
+    if (Net.empty())
+    {
+        return false;
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("DNN face detector loaded successfully (%dx%d input)"), InputSize, InputSize);
+    return true;
+}
+
+void FDnnFaceDetector::Detect(const cv::Mat& Image, const FFaceQualityLevel& Quality, cv::Size MinSize, cv::Size MaxSize, std::vector<cv::Rect>& OutFaces)
+{
+    OutFaces.clear();
+
+    // The SSD is trained on colour, replicate the grayscale detection frame into three channels
+    const cv::Mat* Input = &Image;
+    if (Image.channels() == 1)
+    {
+        cv::cvtColor(Image, ColorInput, cv::COLOR_GRAY2BGR);
+        Input = &ColorInput;
+    }
+
+    // Mean values the res10 SSD was trained with
+    cv::dnn::blobFromImage(*Input, InputBlob, 1.0, cv::Size(InputSize, InputSize), cv::Scalar(104.0, 177.0, 123.0), false, false);
+    Net.setInput(InputBlob);
+    Net.forward(OutputBlob);
+
+    // One row per detection: image id, class, confidence, then left, top, right, bottom normalised to the input
+    const int32 NumDetections = OutputBlob.size[2];
+    const float* Detection = OutputBlob.ptr<float>();
+    const cv::Rect ImageRect(0, 0, Image.cols, Image.rows);
+
+    for (int32 DetectionIndex = 0; DetectionIndex < NumDetections; DetectionIndex++, Detection += 7)
+    {
+        if (Detection[2] < ConfidenceThreshold)
+        {
+            continue;
+        }
+
+        const int32 Left = FMath::RoundToInt(Detection[3] * Image.cols);
+        const int32 Top = FMath::RoundToInt(Detection[4] * Image.rows);
+        const int32 Right = FMath::RoundToInt(Detection[5] * Image.cols);
+        const int32 Bottom = FMath::RoundToInt(Detection[6] * Image.rows);
+        const cv::Rect Face = cv::Rect(Left, Top, Right - Left, Bottom - Top) & ImageRect;
+
+        // Same size limits the cascade applies
+        if (Face.width < MinSize.width || Face.height < MinSize.height)
+        {
+            continue;
+        }
+        if (!MaxSize.empty() && (Face.width > MaxSize.width || Face.height > MaxSize.height))
+        {
+            continue;
+        }
+
+        OutFaces.push_back(Face);
+    }
+}
+
+FString FDnnFaceDetector::GetDescription() const
+{
+    return FString::Printf(TEXT("DNN SSD %s"), *FPaths::GetCleanFilename(ModelPath));
+}
@@ -0,0 +1,106 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PreOpenCVHeaders.h"
+#include "opencv2/opencv.hpp"
+#include "opencv2/dnn.hpp"
+#include "PostOpenCVHeaders.h"
+
+#include "FaceQualityController.h"
+
+#include "FaceDetector.generated.h"
+
+
+UENUM(BlueprintType)
+enum class EFaceDetectorBackend : uint8
+{
+	// Viola-Jones cascade, cheap at a single scale but slow over a full pyramid and frontal only
+	HaarCascade     UMETA(DisplayName = "Haar Cascade"),
+	// SSD face detector on cv::dnn, CPU only. Fixed cost per call, handles off-axis faces
+	DnnSsd          UMETA(DisplayName = "DNN (SSD)")
+};
+
+
+// Everything needed to create a face detector
+struct FFaceDetectorConfig
+{
+	EFaceDetectorBackend Backend = EFaceDetectorBackend::HaarCascade;
+	
+	FString HaarCascadePath;
+	
+	// Caffe or ONNX SSD model with a [1, 1, N, 7] detection output, e.g. OpenCV's res10_300x300 face detector
+	FString DnnModelPath;
+	// Network description for formats that need one (Caffe prototxt), empty otherwise
+	FString DnnConfigPath;
+	
+	float DnnConfidenceThreshold = 0.5f;
+	int32 DnnInputSize = 300;
+};
+
+
+// Read a cv::dnn model set up for the CPU, shared by every DNN backend. ConfigPath may be empty.
+// cv::dnn throws on missing, corrupt and unsupported models, and models load on pool threads where an
+// uncaught exception ends the process, so this logs and returns an empty net instead
+cv::dnn::Net LoadDnnNet(const FString& ModelPath, const FString& ConfigPath, const TCHAR* ModelName);
+
+
+// Finds faces in the grayscale detection frame. Not thread safe, each instance is used by one thread at a time
+class IFaceDetector
+{
+public:
+	virtual ~IFaceDetector() {}
+
+	// Load the model, logs and returns false on failure
+	virtual bool Load() = 0;
+
+	// Faces between MinSize and MaxSize in Image coordinates. An empty MaxSize means no upper bound
+	virtual void Detect(const cv::Mat& Image, const FFaceQualityLevel& Quality, cv::Size MinSize, cv::Size MaxSize, std::vector<cv::Rect>& OutFaces) = 0;
+
+	virtual FString GetDescription() const = 0;
+
+	static TUniquePtr<IFaceDetector> Create(const FFaceDetectorConfig& Config);
+};
+
+
+// Haar cascade through cv::CascadeClassifier::detectMultiScale
+class FHaarFaceDetector : public IFaceDetector
+{
+public:
+	explicit FHaarFaceDetector(const FString& InCascadePath);
+
+	virtual bool Load() override;
+	virtual void Detect(const cv::Mat& Image, const FFaceQualityLevel& Quality, cv::Size MinSize, cv::Size MaxSize, std::vector<cv::Rect>& OutFaces) override;
+	virtual FString GetDescription() const override;
+
+private:
+	FString CascadePath;
+	cv::CascadeClassifier Cascade;
+};
+
+
+// Single-shot detector through cv::dnn, run on the CPU
+class FDnnFaceDetector : public IFaceDetector
+{
+public:
+	FDnnFaceDetector(const FString& InModelPath, const FString& InConfigPath, float InConfidenceThreshold, int32 InInputSize);
+
+	virtual bool Load() override;
+	virtual void Detect(const cv::Mat& Image, const FFaceQualityLevel& Quality, cv::Size MinSize, cv::Size MaxSize, std::vector<cv::Rect>& OutFaces) override;
+	virtual FString GetDescription() const override;
+
+private:
+	FString ModelPath;
+	FString ConfigPath;
+	float ConfidenceThreshold;
+	int32 InputSize;
+
+	cv::dnn::Net Net;
+
+	// Reused between calls so steady state detection doesn't allocate
+	cv::Mat ColorInput;
+	cv::Mat InputBlob;
+	cv::Mat OutputBlob;
+};
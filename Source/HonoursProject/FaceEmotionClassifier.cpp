@@ -0,0 +1,88 @@
+
+#include "FaceEmotionClassifier.h"
+#include "FaceTracker.h"
+#include "FaceDetector.h"
+
+
+FDnnEmotionClassifier::FDnnEmotionClassifier(const FEmotionClassifierSettings& InSettings)
+: Settings(InSettings)
+{
+    Settings.InputSize = FMath::Max(Settings.InputSize, 16);
+}
+
+bool FDnnEmotionClassifier::Load()
+{
+    Net = LoadDnnNet(Settings.ModelPath, FString(), TEXT("emotion classifier"));
+    if (Net.empty())
+    {
+        return false;
+    }
+
+    TArray<FString> Labels;
+    Settings.Labels.ParseIntoArray(Labels, TEXT(","));
+    OutputEmotions.Reset(Labels.Num());
+    for (const FString& Label : Labels)
+    {
+        OutputEmotions.Add((int32)StaticEnum<EFacialEmotion>()->GetValueByNameString(Label.TrimStartAndEnd()));
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("Emotion classifier loaded successfully (%d classes)"), OutputEmotions.Num());
+    return true;
+}
+
+void FDnnEmotionClassifier::Classify(const cv::Mat& GrayFrame, const std::vector<cv::Rect>& Faces, TArray<float>& OutProbabilities)
+{
+    const int32 NumFaces = Faces.size();
+    OutProbabilities.SetNumZeroed(NumFaces * NumEmotions);
+    if (NumFaces == 0)
+    {
+        return;
+    }
+
+    // Pack every face into one N x 1 x H x W blob
+    const cv::Size InputSize(Settings.InputSize, Settings.InputSize);
+    Crops.resize(NumFaces);
+    for (int32 FaceIndex = 0; FaceIndex < NumFaces; FaceIndex++)
+    {
+        cv::resize(GrayFrame(Faces[FaceIndex]), Crops[FaceIndex], InputSize, 0.0, 0.0, cv::INTER_AREA);
+    }
+    cv::dnn::blobFromImages(Crops, InputBlob, Settings.InputScale, InputSize, cv::Scalar(), false, false);
+
+    Net.setInput(InputBlob);
+    Net.forward(OutputBlob);
+
+    const int32 NumClasses = FMath::Min((int32)(OutputBlob.total() / NumFaces), OutputEmotions.Num());
+    for (int32 FaceIndex = 0; FaceIndex < NumFaces; FaceIndex++)
+    {
+        const float* Scores = OutputBlob.ptr<float>() + FaceIndex * (OutputBlob.total() / NumFaces);
+        float* Probabilities = OutProbabilities.GetData() + FaceIndex * NumEmotions;
+
+        float MaxScore = -MAX_flt;
+        for (int32 Class = 0; Class < NumClasses; Class++)
+        {
+            MaxScore = FMath::Max(MaxScore, Scores[Class]);
+        }
+
+        float Total = 0.0f;
+        for (int32 Class = 0; Class < NumClasses; Class++)
+        {
+            if (OutputEmotions[Class] == INDEX_NONE)
+            {
+                continue;
+            }
+
+            const float Probability = Settings.bApplySoftmax ? FMath::Exp(Scores[Class] - MaxScore) : FMath::Max(Scores[Class], 0.0f);
+            Probabilities[OutputEmotions[Class]] += Probability;
+            Total += Probability;
+        }
+
+        // Renormalise over the classes EFacialEmotion has
+        if (Total > 0.0f)
+        {
+            for (int32 Emotion = 0; Emotion < NumEmotions; Emotion++)
+            {
+                Probabilities[Emotion] /= Total;
+            }
+        }
+    }
+}
@@ -0,0 +1,91 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PreOpenCVHeaders.h"
+#include "opencv2/opencv.hpp"
+#include "opencv2/dnn.hpp"
+#include "PostOpenCVHeaders.h"
+
+#include "FaceEmotionClassifier.generated.h"
+
+
+UENUM(BlueprintType)
+enum class EEmotionClassifierBackend : uint8
+{
+	// Rules over Haar eye and smile detections, two extra cascades per face
+	HaarFeatures    UMETA(DisplayName = "Haar Features"),
+	// Rules over eye, mouth and brow geometry from one landmark fit per face
+	Landmarks       UMETA(DisplayName = "Landmark Geometry"),
+	// FER-style CNN on cv::dnn, every face of a frame classified in one forward pass
+	DnnFer          UMETA(DisplayName = "DNN (FER)")
+};
+
+
+USTRUCT(BlueprintType)
+struct FEmotionClassifierSettings
+{
+	GENERATED_BODY()
+	
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion")
+	EEmotionClassifierBackend Backend = EEmotionClassifierBackend::HaarFeatures;
+	
+	// ONNX model taking an N x 1 x InputSize x InputSize grayscale batch and returning N x classes scores
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion", meta = (EditCondition = "Backend == EEmotionClassifierBackend::DnnFer"))
+	FString ModelPath;
+	
+	// EFacialEmotion name of each model output in order, outputs with other names (e.g. Contempt) are ignored.
+	// The default is the FER2013 class order
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion", meta = (EditCondition = "Backend == EEmotionClassifierBackend::DnnFer"))
+	FString Labels = TEXT("Angry,Disgusted,Fearful,Happy,Sad,Surprised,Neutral");
+	
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion", meta = (EditCondition = "Backend == EEmotionClassifierBackend::DnnFer", ClampMin = 16, ClampMax = 256))
+	int32 InputSize = 48;
+	
+	// Multiplier applied to 0-255 pixel values, 1 for models trained on raw pixels
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion", meta = (EditCondition = "Backend == EEmotionClassifierBackend::DnnFer"))
+	float InputScale = 1.0f / 255.0f;
+	
+	// The model returns raw logits, e.g. the ONNX zoo FER+ model. Turn off for models whose last layer is already a softmax
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion", meta = (EditCondition = "Backend == EEmotionClassifierBackend::DnnFer"))
+	bool bApplySoftmax = true;
+	
+	// ONNX regressor taking an N x 3 x LandmarkInputSize x LandmarkInputSize batch of face crops
+	// and returning 68 iBUG points per face as x, y pairs normalised to the crop
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion", meta = (EditCondition = "Backend == EEmotionClassifierBackend::Landmarks"))
+	FString LandmarkModelPath;
+	
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion", meta = (EditCondition = "Backend == EEmotionClassifierBackend::Landmarks", ClampMin = 32, ClampMax = 256))
+	int32 LandmarkInputSize = 112;
+};
+
+
+// Classifies face crops with a CNN through cv::dnn. Not thread safe, used by the classification stage only
+class FDnnEmotionClassifier
+{
+public:
+	// Scores per face, indexed by EFacialEmotion
+	static constexpr int32 NumEmotions = 7;
+
+	explicit FDnnEmotionClassifier(const FEmotionClassifierSettings& InSettings);
+
+	// Load the model, logs and returns false on failure
+	bool Load();
+
+	// Classify every face of a frame in a single forward pass. OutProbabilities gets NumEmotions values per face
+	void Classify(const cv::Mat& GrayFrame, const std::vector<cv::Rect>& Faces, TArray<float>& OutProbabilities);
+
+private:
+	FEmotionClassifierSettings Settings;
+	cv::dnn::Net Net;
+
+	// EFacialEmotion of each model output, INDEX_NONE if unused
+	TArray<int32> OutputEmotions;
+
+	// Reused between frames
+	std::vector<cv::Mat> Crops;
+	cv::Mat InputBlob;
+	cv::Mat OutputBlob;
+};
@@ -0,0 +1,201 @@
+
+#include "FaceEmotionLog.h"
+#include "HAL/PlatformFileManager.h"
+#include "Async/MappedFileHandle.h"
+#include "Misc/Paths.h"
+
+
+FFaceEmotionRecorder::FFaceEmotionRecorder()
+    : bRunning(false)
+{
+}
+
+FFaceEmotionRecorder::~FFaceEmotionRecorder()
+{
+    Close();
+}
+
+bool FFaceEmotionRecorder::Open(const FString& InPath, FIntPoint FrameSize)
+{
+    Close();
+
+    Path = InPath;
+    IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+    PlatformFile.CreateDirectoryTree(*FPaths::GetPath(Path));
+    File = PlatformFile.OpenWrite(*Path);
+    if (!File)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to create emotion log %s"), *Path);
+        return false;
+    }
+
+    FFaceEmotionLogHeader Header;
+    Header.RecordSize = sizeof(FFaceEmotionRecord);
+    Header.NumEmotions = FDnnEmotionClassifier::NumEmotions;
+    Header.FrameWidth = FrameSize.X;
+    Header.FrameHeight = FrameSize.Y;
+    File->Write(reinterpret_cast<const uint8*>(&Header), sizeof(Header));
+
+    StartTime = FPlatformTime::Seconds();
+    ChunkStartTime = StartTime;
+    CurrentChunk.Reserve(ChunkRecords);
+
+    WakeEvent = FPlatformProcess::GetSynchEventFromPool(false);
+    bRunning = true;
+    Thread = FRunnableThread::Create(this, TEXT("FaceEmotionRecorder"), 0, TPri_BelowNormal);
+
+    UE_LOG(LogTemp, Log, TEXT("Recording emotions to %s"), *Path);
+    return true;
+}
+
+void FFaceEmotionRecorder::Close()
+{
+    if (!File)
+    {
+        return;
+    }
+
+    // Hand off the last partial chunk, the writer drains the queue before it exits
+    SubmitChunk();
+    Stop();
+    if (Thread)
+    {
+        Thread->WaitForCompletion();
+        delete Thread;
+        Thread = nullptr;
+    }
+    FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+    WakeEvent = nullptr;
+
+    delete File;
+    File = nullptr;
+    FreeChunks.Empty();
+    CurrentChunk.Empty();
+}
+
+void FFaceEmotionRecorder::Append(const FFaceEmotionRecord* Records, int32 NumRecords)
+{
+    if (!File)
+    {
+        return;
+    }
+
+    // Reuse a written chunk if one is back, otherwise keep growing the current one rather than wait for the disk
+    if (CurrentChunk.Num() == 0)
+    {
+        FreeChunks.Dequeue(CurrentChunk);
+    }
+    CurrentChunk.Append(Records, NumRecords);
+
+    const double Now = FPlatformTime::Seconds();
+    if (CurrentChunk.Num() >= ChunkRecords || Now - ChunkStartTime >= MaxChunkAge)
+    {
+        SubmitChunk();
+        ChunkStartTime = Now;
+    }
+}
+
+void FFaceEmotionRecorder::SubmitChunk()
+{
+    if (CurrentChunk.Num() > 0)
+    {
+        FullChunks.Enqueue(MoveTemp(CurrentChunk));
+        CurrentChunk.Reset();
+        WakeEvent->Trigger();
+    }
+}
+
+uint32 FFaceEmotionRecorder::Run()
+{
+    while (bRunning)
+    {
+        WakeEvent->Wait(100);
+        WriteFullChunks();
+    }
+
+    WriteFullChunks();
+    File->Flush();
+    return 0;
+}
+
+void FFaceEmotionRecorder::Stop()
+{
+    bRunning = false;
+    if (WakeEvent)
+    {
+        WakeEvent->Trigger();
+    }
+}
+
+void FFaceEmotionRecorder::WriteFullChunks()
+{
+    FRecordChunk Chunk;
+    while (FullChunks.Dequeue(Chunk))
+    {
+        File->Write(reinterpret_cast<const uint8*>(Chunk.GetData()), Chunk.Num() * sizeof(FFaceEmotionRecord));
+        Chunk.Reset();
+        FreeChunks.Enqueue(MoveTemp(Chunk));
+    }
+}
+
+FFaceEmotionLogReader::~FFaceEmotionLogReader()
+{
+    Close();
+}
+
+bool FFaceEmotionLogReader::Open(const FString& Path)
+{
+    Close();
+
+    MappedFile = FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Path);
+    if (!MappedFile || MappedFile->GetFileSize() < (int64)sizeof(FFaceEmotionLogHeader))
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to map emotion log %s"), *Path);
+        Close();
+        return false;
+    }
+
+    MappedRegion = MappedFile->MapRegion(0, MappedFile->GetFileSize());
+    if (!MappedRegion)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to map emotion log %s"), *Path);
+        Close();
+        return false;
+    }
+
+    const uint8* Data = MappedRegion->GetMappedPtr();
+    FMemory::Memcpy(&Header, Data, sizeof(Header));
+    if (Header.Magic != FFaceEmotionLogHeader::ExpectedMagic || Header.Version != FFaceEmotionLogHeader::CurrentVersion
+        || Header.RecordSize != sizeof(FFaceEmotionRecord) || Header.NumEmotions != FDnnEmotionClassifier::NumEmotions)
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s is not a version %d emotion log"), *Path, FFaceEmotionLogHeader::CurrentVersion);
+        Close();
+        return false;
+    }
+
+    Records = reinterpret_cast<const FFaceEmotionRecord*>(Data + sizeof(Header));
+    NumRecords = (int32)((MappedRegion->GetMappedSize() - sizeof(Header)) / sizeof(FFaceEmotionRecord));
+
+    UE_LOG(LogTemp, Log, TEXT("Mapped emotion log %s: %d records"), *Path, NumRecords);
+    return true;
+}
+
+void FFaceEmotionLogReader::Close()
+{
+    delete MappedRegion;
+    MappedRegion = nullptr;
+    delete MappedFile;
+    MappedFile = nullptr;
+    Records = nullptr;
+    NumRecords = 0;
+}
+
+int32 FFaceEmotionLogReader::GetFrameEnd(int32 Index) const
+{
+    int32 End = Index + 1;
+    while (End < NumRecords && Records[End].Sequence == Records[Index].Sequence)
+    {
+        End++;
+    }
+    return End;
+}
@@ -0,0 +1,154 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Containers/Queue.h"
+
+#include "FaceEmotionClassifier.h"
+
+#include "FaceEmotionLog.generated.h"
+
+class IFileHandle;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+
+USTRUCT(BlueprintType)
+struct FFaceEmotionLogSettings
+{
+	GENERATED_BODY()
+
+	// Append every processed frame to Saved/EmotionLogs/<date>.femo
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion Log")
+	bool bRecord = false;
+
+	// Replay this log instead of opening the camera, no frames are captured or classified
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion Log")
+	FString ReplayPath;
+
+	// Start the replay over when it reaches the end
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion Log")
+	bool bLoopReplay = false;
+};
+
+
+// File header, followed by tightly packed FFaceEmotionRecords
+struct FFaceEmotionLogHeader
+{
+	static constexpr uint32 ExpectedMagic = 0x4F4D4546; // "FEMO"
+	static constexpr uint16 CurrentVersion = 1;
+
+	uint32 Magic = ExpectedMagic;
+	uint16 Version = CurrentVersion;
+	uint16 RecordSize = 0;
+	uint16 NumEmotions = 0;
+	uint16 Padding = 0;
+	int32 FrameWidth = 0;
+	int32 FrameHeight = 0;
+	uint32 Reserved = 0;
+};
+static_assert(sizeof(FFaceEmotionLogHeader) == 24, "Emotion log header layout changed, bump CurrentVersion");
+
+
+// One face of one processed frame. A frame without faces is logged as a single record with FaceId 0,
+// so replay sees faces leave at the same frame they did live.
+struct FFaceEmotionRecord
+{
+	// Seconds since recording started, at capture
+	double Time;
+	// Processed frame number, shared by every face of the frame
+	uint64 Sequence;
+	int32 FaceId;
+	float LatencyMs;
+	// Smoothed, indexed by EFacialEmotion
+	float Probabilities[FDnnEmotionClassifier::NumEmotions];
+	// Full resolution face rect
+	int32 FaceX;
+	int32 FaceY;
+	int32 FaceWidth;
+	int32 FaceHeight;
+	// EFacialEmotion after and before smoothing
+	uint8 Emotion;
+	uint8 RawEmotion;
+	uint8 Padding[2];
+};
+static_assert(sizeof(FFaceEmotionRecord) == 72, "Emotion record layout changed, bump FFaceEmotionLogHeader::CurrentVersion");
+
+
+// Appends records to a log file from a writer thread. Append never touches the disk: records are gathered
+// into chunks that are handed to the writer through a lock-free queue and recycled once written.
+class FFaceEmotionRecorder : public FRunnable
+{
+public:
+	FFaceEmotionRecorder();
+	virtual ~FFaceEmotionRecorder();
+
+	// Writes the header and starts the writer thread
+	bool Open(const FString& InPath, FIntPoint FrameSize);
+
+	// Writes everything appended so far and closes the file
+	void Close();
+
+	// Seconds since Open, the time base of FFaceEmotionRecord::Time
+	double GetRecordingTime(double PlatformSeconds) const { return PlatformSeconds - StartTime; }
+
+	// Single producer, call from one thread only
+	void Append(const FFaceEmotionRecord* Records, int32 NumRecords);
+
+	const FString& GetPath() const { return Path; }
+
+	// FRunnable interface
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	typedef TArray<FFaceEmotionRecord> FRecordChunk;
+
+	// Records per chunk before it is handed off, and the longest a record waits before being handed off
+	static constexpr int32 ChunkRecords = 512;
+	static constexpr double MaxChunkAge = 1.0;
+
+	FString Path;
+	IFileHandle* File = nullptr;
+	double StartTime = 0.0;
+
+	FRecordChunk CurrentChunk;
+	double ChunkStartTime = 0.0;
+	TQueue<FRecordChunk, EQueueMode::Spsc> FullChunks;
+	TQueue<FRecordChunk, EQueueMode::Spsc> FreeChunks;
+
+	FEvent* WakeEvent = nullptr;
+	FThreadSafeBool bRunning;
+	FRunnableThread* Thread = nullptr;
+
+	void SubmitChunk();
+	void WriteFullChunks();
+};
+
+
+// Memory maps a log for replay. Records are read in place, a log cut short by a crash loses only its last partial record
+class FFaceEmotionLogReader
+{
+public:
+	~FFaceEmotionLogReader();
+
+	bool Open(const FString& Path);
+	void Close();
+
+	const FFaceEmotionLogHeader& GetHeader() const { return Header; }
+	const FFaceEmotionRecord* GetRecords() const { return Records; }
+	int32 Num() const { return NumRecords; }
+
+	// One past the last record of the frame starting at Index
+	int32 GetFrameEnd(int32 Index) const;
+
+private:
+	FFaceEmotionLogHeader Header;
+	IMappedFileHandle* MappedFile = nullptr;
+	IMappedFileRegion* MappedRegion = nullptr;
+	const FFaceEmotionRecord* Records = nullptr;
+	int32 NumRecords = 0;
+};
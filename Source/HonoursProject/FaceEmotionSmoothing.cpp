@@ -0,0 +1,96 @@
+
+#include "FaceEmotionSmoothing.h"
+
+
+FEmotionSmoother::FEmotionSmoother(const FEmotionSmoothingSettings& InSettings)
+{
+    SetSettings(InSettings);
+}
+
+void FEmotionSmoother::SetSettings(const FEmotionSmoothingSettings& InSettings)
+{
+    Settings = InSettings;
+    Settings.HistorySize = FMath::Max(Settings.HistorySize, 1);
+    Settings.Alpha = FMath::Clamp(Settings.Alpha, 0.01f, 1.0f);
+    Faces.Reset();
+}
+
+int32 FEmotionSmoother::Update(int32 FaceKey, const float* Probabilities, float* OutSmoothed)
+{
+    FFaceHistory& Face = Faces.FindOrAdd(FaceKey);
+    Face.LastUpdate = FrameNumber;
+    
+    const bool bNewFace = Face.NumFrames == 0;
+    if (bNewFace)
+    {
+        Face.Ring.SetNumZeroed(Settings.HistorySize * NumEmotions);
+    }
+    
+    // Swap the oldest frame out of the running sums
+    float* Slot = Face.Ring.GetData() + Face.NextFrame * NumEmotions;
+    const bool bRingFull = Face.NumFrames == Settings.HistorySize;
+    for (int32 Emotion = 0; Emotion < NumEmotions; Emotion++)
+    {
+        if (bRingFull)
+        {
+            Face.Sums[Emotion] -= Slot[Emotion];
+        }
+        Slot[Emotion] = Probabilities[Emotion];
+        Face.Sums[Emotion] += Probabilities[Emotion];
+        
+        Face.Average[Emotion] = bNewFace ? Probabilities[Emotion] : FMath::Lerp(Face.Average[Emotion], Probabilities[Emotion], Settings.Alpha);
+    }
+    Face.NextFrame = (Face.NextFrame + 1) % Settings.HistorySize;
+    Face.NumFrames = FMath::Min(Face.NumFrames + 1, Settings.HistorySize);
+    
+    // Rebuild the sums once per lap so float error can't accumulate, still constant cost per frame on average
+    if (Face.NextFrame == 0)
+    {
+        FMemory::Memzero(Face.Sums, sizeof(Face.Sums));
+        for (int32 Frame = 0; Frame < Face.NumFrames; Frame++)
+        {
+            for (int32 Emotion = 0; Emotion < NumEmotions; Emotion++)
+            {
+                Face.Sums[Emotion] += Face.Ring[Frame * NumEmotions + Emotion];
+            }
+        }
+    }
+    
+    // The emotion most present over the window is the candidate
+    int32 Candidate = 0;
+    for (int32 Emotion = 1; Emotion < NumEmotions; Emotion++)
+    {
+        if (Face.Sums[Emotion] > Face.Sums[Candidate])
+        {
+            Candidate = Emotion;
+        }
+    }
+    
+    // A new face starts straight away, after that the candidate has to clear both thresholds
+    if (Face.StableEmotion == INDEX_NONE)
+    {
+        Face.StableEmotion = Candidate;
+    }
+    else if (Candidate != Face.StableEmotion
+        && Face.Average[Candidate] >= Settings.EnterThreshold
+        && Face.Average[Face.StableEmotion] <= Settings.ExitThreshold)
+    {
+        Face.StableEmotion = Candidate;
+    }
+    
+    FMemory::Memcpy(OutSmoothed, Face.Average, sizeof(Face.Average));
+    return Face.StableEmotion;
+}
+
+void FEmotionSmoother::EndFrame(int32 MaxMissedFrames)
+{
+    for (auto It = Faces.CreateIterator(); It; ++It)
+    {
+        if (FrameNumber - It.Value().LastUpdate > (uint32)FMath::Max(MaxMissedFrames, 0))
+        {
+            It.RemoveCurrent();
+        }
+    }
+    
+    FrameNumber++;
+}
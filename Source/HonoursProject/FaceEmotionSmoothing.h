@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "FaceEmotionClassifier.h"
+
+#include "FaceEmotionSmoothing.generated.h"
+
+
+USTRUCT(BlueprintType)
+struct FEmotionSmoothingSettings
+{
+	GENERATED_BODY()
+	
+	// Frames of probabilities averaged per face
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion", meta = (ClampMin = 1, ClampMax = 120))
+	int32 HistorySize = 10;
+	
+	// Weight of the newest frame in the moving average, lower is smoother but slower to react
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion", meta = (ClampMin = 0.01, ClampMax = 1))
+	float Alpha = 0.3f;
+	
+	// Averaged probability an emotion needs to become the face's emotion
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion", meta = (ClampMin = 0, ClampMax = 1))
+	float EnterThreshold = 0.5f;
+	
+	// Averaged probability below which the current emotion can be replaced. Lower than EnterThreshold so
+	// an emotion hovering around one threshold doesn't flip back and forth
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Emotion", meta = (ClampMin = 0, ClampMax = 1))
+	float ExitThreshold = 0.35f;
+};
+
+
+// Per-face emotion smoothing with hysteresis, constant cost per face per frame.
+// Each face keeps a ring of its last HistorySize probability vectors with running per-emotion sums, and an
+// exponential moving average. The window mean picks the candidate emotion, the moving average gates the switch.
+class FEmotionSmoother
+{
+public:
+	static constexpr int32 NumEmotions = FDnnEmotionClassifier::NumEmotions;
+
+	explicit FEmotionSmoother(const FEmotionSmoothingSettings& InSettings = FEmotionSmoothingSettings());
+
+	// Clears all faces
+	void SetSettings(const FEmotionSmoothingSettings& InSettings);
+
+	// Add a frame for the face with this key. Returns the face's stable emotion, OutSmoothed gets the moving average
+	int32 Update(int32 FaceKey, const float* Probabilities, float* OutSmoothed);
+
+	// Forget faces that weren't updated in the last MaxMissedFrames + 1 frames
+	void EndFrame(int32 MaxMissedFrames = 0);
+
+private:
+	struct FFaceHistory
+	{
+		// HistorySize frames of NumEmotions probabilities
+		TArray<float> Ring;
+		int32 NextFrame = 0;
+		int32 NumFrames = 0;
+		
+		float Sums[NumEmotions] = {};
+		float Average[NumEmotions] = {};
+		
+		int32 StableEmotion = INDEX_NONE;
+		uint32 LastUpdate = 0;
+	};
+
+	FEmotionSmoothingSettings Settings;
+	TMap<int32, FFaceHistory> Faces;
+	uint32 FrameNumber = 1;
+};
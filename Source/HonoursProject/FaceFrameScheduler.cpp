@@ -0,0 +1,67 @@
+
+#include "FaceFrameScheduler.h"
+#include "FaceFrameSource.h"
+#include "HAL/PlatformProcess.h"
+
+
+FFaceFrameScheduler::FFaceFrameScheduler(float InTargetFrameRate)
+: FrameInterval(1.0 / FMath::Max(InTargetFrameRate, 1.0f))
+{
+}
+
+void FFaceFrameScheduler::Reset()
+{
+    FrameStartTime = FPlatformTime::Seconds();
+}
+
+void FFaceFrameScheduler::SetTargetFrameRate(float InTargetFrameRate)
+{
+    FrameInterval = 1.0 / FMath::Max(InTargetFrameRate, 1.0f);
+}
+
+void FFaceFrameScheduler::WaitForNextFrame(IFaceFrameSource& Source)
+{
+    const double Now = FPlatformTime::Seconds();
+    const double Deadline = FrameStartTime + FrameInterval;
+    
+    Frames.fetch_add(1, std::memory_order_relaxed);
+    LastFrameMs.store((float)((Now - FrameStartTime) * 1000.0), std::memory_order_relaxed);
+    
+    if (Now <= Deadline)
+    {
+        FPlatformProcess::Sleep((float)(Deadline - Now));
+        FrameStartTime = Deadline;
+        return;
+    }
+    
+    FramesLate.fetch_add(1, std::memory_order_relaxed);
+    
+    // Whole slots missed, the source has frames queued up from them that are no longer worth processing
+    const int32 MissedFrames = FMath::FloorToInt32((Now - Deadline) / FrameInterval);
+    if (MissedFrames > 0)
+    {
+        FramesDropped.fetch_add(Source.DropStaleFrames(MissedFrames), std::memory_order_relaxed);
+        FrameStartTime = FPlatformTime::Seconds();
+    }
+    else
+    {
+        // Slightly late, start straight away but keep the original cadence
+        FrameStartTime = Deadline;
+    }
+}
+
+void FFaceFrameScheduler::WaitAfterFailedRead()
+{
+    FPlatformProcess::Sleep((float)FrameInterval);
+    FrameStartTime = FPlatformTime::Seconds();
+}
+
+FFaceSchedulerStats FFaceFrameScheduler::GetStats() const
+{
+    FFaceSchedulerStats Stats;
+    Stats.Frames = Frames.load(std::memory_order_relaxed);
+    Stats.FramesLate = FramesLate.load(std::memory_order_relaxed);
+    Stats.FramesDropped = FramesDropped.load(std::memory_order_relaxed);
+    Stats.LastFrameMs = LastFrameMs.load(std::memory_order_relaxed);
+    return Stats;
+}
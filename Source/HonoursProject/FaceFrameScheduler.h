@@ -0,0 +1,68 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <atomic>
+
+#include "FaceFrameScheduler.generated.h"
+
+class IFaceFrameSource;
+
+
+USTRUCT(BlueprintType)
+struct FFaceSchedulerStats
+{
+	GENERATED_BODY()
+	
+	UPROPERTY(BlueprintReadOnly, Category = "Scheduling")
+	int32 Frames = 0;
+	
+	// Frames that finished after their deadline
+	UPROPERTY(BlueprintReadOnly, Category = "Scheduling")
+	int32 FramesLate = 0;
+	
+	// Stale frames discarded from the source to catch up
+	UPROPERTY(BlueprintReadOnly, Category = "Scheduling")
+	int32 FramesDropped = 0;
+	
+	// Processing time of the last frame, before any sleep
+	UPROPERTY(BlueprintReadOnly, Category = "Scheduling")
+	float LastFrameMs = 0.0f;
+};
+
+
+// Paces the processing thread to a target frame rate. Each frame gets a fixed slot, the thread sleeps
+// for whatever is left of the slot after processing. When a frame overruns by whole slots the frames
+// that piled up in the source are dropped and the schedule restarts from now, rather than bursting to catch up.
+class FFaceFrameScheduler
+{
+public:
+	explicit FFaceFrameScheduler(float InTargetFrameRate);
+
+	// Start the schedule, call before the first frame
+	void Reset();
+
+	// Takes effect from the next frame
+	void SetTargetFrameRate(float InTargetFrameRate);
+
+	// Call once a captured frame has been handed off, never after a failed read. Sleeps until the next frame is due
+	void WaitForNextFrame(IFaceFrameSource& Source);
+
+	// Call when the source had no frame, e.g. at the end of a clip that doesn't loop. Sleeps one slot
+	// and restarts the schedule, so a source that keeps failing is polled at the frame rate instead of in a busy loop
+	void WaitAfterFailedRead();
+
+	// Safe to call from any thread
+	FFaceSchedulerStats GetStats() const;
+
+private:
+	double FrameInterval;
+	double FrameStartTime = 0.0;
+
+	std::atomic<int32> Frames{0};
+	std::atomic<int32> FramesLate{0};
+	std::atomic<int32> FramesDropped{0};
+	std::atomic<float> LastFrameMs{0.0f};
+};
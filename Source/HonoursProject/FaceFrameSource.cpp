@@ -0,0 +1,383 @@
+
+#include "FaceFrameSource.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/Paths.h"
+
+
+static FString ResolveSourcePath(const FString& Path)
+{
+    return FPaths::IsRelative(Path) ? FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), Path) : Path;
+}
+
+TUniquePtr<IFaceFrameSource> IFaceFrameSource::Create(const FFaceFrameSourceSettings& Settings, FIntPoint RequestedSize, float RequestedFrameRate)
+{
+    switch (Settings.SourceType)
+    {
+        case EFaceFrameSourceType::VideoFile:
+            return MakeUnique<FVideoFileFrameSource>(ResolveSourcePath(Settings.SourcePath), Settings.Pacing, Settings.bLoop);
+        case EFaceFrameSourceType::ImageSequence:
+            return MakeUnique<FImageSequenceFrameSource>(ResolveSourcePath(Settings.SourcePath), Settings.SequenceFrameRate, Settings.Pacing, Settings.bLoop);
+        default:
+            return MakeUnique<FCameraFrameSource>(Settings.CameraIndex, RequestedSize, RequestedFrameRate, Settings.CameraFormat);
+    }
+}
+
+FCameraFrameSource::FCameraFrameSource(int32 InCameraIndex, FIntPoint InRequestedSize, float InRequestedFrameRate, EFaceCameraFormat InRequestedFormat)
+: CameraIndex(InCameraIndex)
+, FrameSize(InRequestedSize)
+, FrameRate(InRequestedFrameRate)
+, RequestedFormat(InRequestedFormat)
+{
+}
+
+FCameraFrameSource::~FCameraFrameSource()
+{
+    Close();
+}
+
+bool FCameraFrameSource::Open()
+{
+    VideoCapture.open(CameraIndex);
+
+    if (!VideoCapture.isOpened())
+    {
+        return false;
+    }
+
+    // Set webcam resolution
+    VideoCapture.set(cv::CAP_PROP_FRAME_WIDTH, FrameSize.X);
+    VideoCapture.set(cv::CAP_PROP_FRAME_HEIGHT, FrameSize.Y);
+    VideoCapture.set(cv::CAP_PROP_FPS, FrameRate);
+    VideoCapture.set(cv::CAP_PROP_BUFFERSIZE, 1); // Minimize buffering
+
+    // MJPEG if asked for, then GREY which needs no work at all, then YUYV which only needs a channel extract
+    FrameFormat = EFaceFrameFormat::Bgr;
+    const bool bRawFormat = (RequestedFormat == EFaceCameraFormat::Mjpeg && NegotiateRawFormat(cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), EFaceFrameFormat::Mjpeg))
+        || (RequestedFormat != EFaceCameraFormat::Bgr && (NegotiateRawFormat(cv::VideoWriter::fourcc('G', 'R', 'E', 'Y'), EFaceFrameFormat::Grey)
+            || NegotiateRawFormat(cv::VideoWriter::fourcc('Y', 'U', 'Y', 'V'), EFaceFrameFormat::Yuyv)));
+    if (!bRawFormat)
+    {
+        VideoCapture.set(cv::CAP_PROP_CONVERT_RGB, 1);
+        if (RequestedFormat != EFaceCameraFormat::Bgr)
+        {
+            UE_LOG(LogTemp, Log, TEXT("Webcam %d offers no raw format, capturing BGR"), CameraIndex);
+        }
+    }
+
+    // Get actual resolution
+    FrameSize.X = VideoCapture.get(cv::CAP_PROP_FRAME_WIDTH);
+    FrameSize.Y = VideoCapture.get(cv::CAP_PROP_FRAME_HEIGHT);
+
+    OpenTime = FPlatformTime::Seconds();
+    FrameTime = 0.0;
+    return true;
+}
+
+void FCameraFrameSource::Close()
+{
+    if (VideoCapture.isOpened())
+    {
+        VideoCapture.release();
+    }
+}
+
+bool FCameraFrameSource::IsOpen() const
+{
+    return VideoCapture.isOpened();
+}
+
+bool FCameraFrameSource::NegotiateRawFormat(int32 FourCC, EFaceFrameFormat Format)
+{
+    // Drivers silently keep their current format if they don't support the one asked for
+    if (!VideoCapture.set(cv::CAP_PROP_FOURCC, FourCC)
+        || (int32)VideoCapture.get(cv::CAP_PROP_FOURCC) != FourCC
+        || !VideoCapture.set(cv::CAP_PROP_CONVERT_RGB, 0))
+    {
+        return false;
+    }
+
+    FrameFormat = Format;
+    UE_LOG(LogTemp, Log, TEXT("%s"), *GetDescription());
+    return true;
+}
+
+bool FCameraFrameSource::ReadFrame(cv::Mat& OutFrame)
+{
+    if (!VideoCapture.read(OutFrame))
+    {
+        return false;
+    }
+
+    // Backends that ignore CONVERT_RGB decode MJPEG anyway, follow what they deliver
+    if (FrameFormat == EFaceFrameFormat::Mjpeg && OutFrame.rows > 1 && OutFrame.channels() == 3)
+    {
+        FrameFormat = EFaceFrameFormat::Bgr;
+    }
+
+    // Some backends hand unconverted frames over as a single row of bytes. MJPEG stays that way for the decoder
+    const int32 RawChannels = FrameFormat == EFaceFrameFormat::Grey ? 1 : FrameFormat == EFaceFrameFormat::Yuyv ? 2 : 0;
+    if (RawChannels > 0 && OutFrame.rows != FrameSize.Y && OutFrame.isContinuous()
+        && OutFrame.total() * OutFrame.elemSize() == (size_t)FrameSize.X * FrameSize.Y * RawChannels)
+    {
+        OutFrame = OutFrame.reshape(RawChannels, FrameSize.Y);
+    }
+
+    FrameTime = FPlatformTime::Seconds() - OpenTime;
+    return true;
+}
+
+int32 FCameraFrameSource::DropStaleFrames(int32 MaxFrames)
+{
+    // The driver buffers a single frame, grab it so the next read waits for a fresh one
+    if (MaxFrames > 0 && VideoCapture.grab())
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+FString FCameraFrameSource::GetDescription() const
+{
+    switch (FrameFormat)
+    {
+        case EFaceFrameFormat::Grey:
+            return FString::Printf(TEXT("Webcam %d (GREY)"), CameraIndex);
+        case EFaceFrameFormat::Yuyv:
+            return FString::Printf(TEXT("Webcam %d (YUYV)"), CameraIndex);
+        case EFaceFrameFormat::Mjpeg:
+            return FString::Printf(TEXT("Webcam %d (MJPEG)"), CameraIndex);
+        default:
+            return FString::Printf(TEXT("Webcam %d"), CameraIndex);
+    }
+}
+
+FRecordedFrameSource::FRecordedFrameSource(const FString& InPath, EFaceFramePacing InPacing, bool bInLoop)
+: Path(InPath)
+, Pacing(InPacing)
+, bLoop(bInLoop)
+{
+}
+
+bool FRecordedFrameSource::ReadFrame(cv::Mat& OutFrame)
+{
+    if (!ReadNextFrame(OutFrame))
+    {
+        return false;
+    }
+
+    // Hold the frame back until its nominal time so replays run at the recorded rate
+    if (Pacing == EFaceFramePacing::RealTime)
+    {
+        const double Now = FPlatformTime::Seconds();
+        if (FramesRead == 0)
+        {
+            PlaybackStartTime = Now;
+        }
+
+        const double DueTime = PlaybackStartTime + FramesRead / FrameRate;
+        if (DueTime > Now)
+        {
+            FPlatformProcess::Sleep(DueTime - Now);
+        }
+    }
+
+    FramesRead++;
+    return true;
+}
+
+int32 FRecordedFrameSource::DropStaleFrames(int32 MaxFrames)
+{
+    // Full speed replays have nothing overdue, benchmarks need every frame
+    if (Pacing != EFaceFramePacing::RealTime || FramesRead == 0)
+    {
+        return 0;
+    }
+
+    // Skip frames whose successor is already due, the next read then returns the current frame without waiting
+    const double Now = FPlatformTime::Seconds();
+    int32 FramesDropped = 0;
+    while (FramesDropped < MaxFrames && PlaybackStartTime + (FramesRead + 1) / FrameRate <= Now && SkipNextFrame())
+    {
+        FramesRead++;
+        FramesDropped++;
+    }
+
+    return FramesDropped;
+}
+
+double FRecordedFrameSource::GetFrameTime() const
+{
+    // Nominal time, identical between runs regardless of pacing
+    return FramesRead > 0 ? (FramesRead - 1) / FrameRate : 0.0;
+}
+
+void FRecordedFrameSource::ResetPacing()
+{
+    FramesRead = 0;
+    PlaybackStartTime = 0.0;
+}
+
+FVideoFileFrameSource::FVideoFileFrameSource(const FString& InPath, EFaceFramePacing InPacing, bool bInLoop)
+: FRecordedFrameSource(InPath, InPacing, bInLoop)
+{
+}
+
+FVideoFileFrameSource::~FVideoFileFrameSource()
+{
+    Close();
+}
+
+bool FVideoFileFrameSource::Open()
+{
+    std::string PathStr(TCHAR_TO_UTF8(*Path));
+    if (!VideoCapture.open(PathStr))
+    {
+        return false;
+    }
+
+    FrameSize.X = VideoCapture.get(cv::CAP_PROP_FRAME_WIDTH);
+    FrameSize.Y = VideoCapture.get(cv::CAP_PROP_FRAME_HEIGHT);
+
+    // Some containers don't report a rate
+    const double FileFrameRate = VideoCapture.get(cv::CAP_PROP_FPS);
+    FrameRate = FileFrameRate > 0.0 ? static_cast<float>(FileFrameRate) : 30.0f;
+
+    ResetPacing();
+    return true;
+}
+
+void FVideoFileFrameSource::Close()
+{
+    if (VideoCapture.isOpened())
+    {
+        VideoCapture.release();
+    }
+}
+
+bool FVideoFileFrameSource::IsOpen() const
+{
+    return VideoCapture.isOpened();
+}
+
+FString FVideoFileFrameSource::GetDescription() const
+{
+    return FString::Printf(TEXT("Video file %s"), *Path);
+}
+
+bool FVideoFileFrameSource::ReadNextFrame(cv::Mat& OutFrame)
+{
+    if (VideoCapture.read(OutFrame))
+    {
+        return true;
+    }
+
+    if (!bLoop)
+    {
+        return false;
+    }
+
+    VideoCapture.set(cv::CAP_PROP_POS_FRAMES, 0);
+    return VideoCapture.read(OutFrame);
+}
+
+bool FVideoFileFrameSource::SkipNextFrame()
+{
+    if (VideoCapture.grab())
+    {
+        return true;
+    }
+
+    if (!bLoop)
+    {
+        return false;
+    }
+
+    VideoCapture.set(cv::CAP_PROP_POS_FRAMES, 0);
+    return VideoCapture.grab();
+}
+
+FImageSequenceFrameSource::FImageSequenceFrameSource(const FString& InPath, float InFrameRate, EFaceFramePacing InPacing, bool bInLoop)
+: FRecordedFrameSource(InPath, InPacing, bInLoop)
+{
+    FrameRate = FMath::Max(InFrameRate, 1.0f);
+}
+
+bool FImageSequenceFrameSource::Open()
+{
+    TArray<FString> FileNames;
+    IFileManager::Get().FindFiles(FileNames, *FPaths::Combine(Path, TEXT("*.png")), true, false);
+    FileNames.Sort();
+
+    FramePaths.Reset(FileNames.Num());
+    for (const FString& FileName : FileNames)
+    {
+        FramePaths.Add(FPaths::Combine(Path, FileName));
+    }
+
+    if (FramePaths.Num() == 0)
+    {
+        return false;
+    }
+
+    // Take the frame size from the first image
+    std::string FirstPathStr(TCHAR_TO_UTF8(*FramePaths[0]));
+    cv::Mat FirstFrame = cv::imread(FirstPathStr, cv::IMREAD_COLOR);
+    if (FirstFrame.empty())
+    {
+        FramePaths.Reset();
+        return false;
+    }
+
+    FrameSize = FIntPoint(FirstFrame.cols, FirstFrame.rows);
+    NextFrameIndex = 0;
+    ResetPacing();
+    return true;
+}
+
+void FImageSequenceFrameSource::Close()
+{
+    FramePaths.Reset();
+}
+
+bool FImageSequenceFrameSource::IsOpen() const
+{
+    return FramePaths.Num() > 0;
+}
+
+FString FImageSequenceFrameSource::GetDescription() const
+{
+    return FString::Printf(TEXT("PNG sequence %s"), *Path);
+}
+
+bool FImageSequenceFrameSource::ReadNextFrame(cv::Mat& OutFrame)
+{
+    if (NextFrameIndex >= FramePaths.Num())
+    {
+        if (!bLoop)
+        {
+            return false;
+        }
+        NextFrameIndex = 0;
+    }
+
+    std::string FramePathStr(TCHAR_TO_UTF8(*FramePaths[NextFrameIndex++]));
+    OutFrame = cv::imread(FramePathStr, cv::IMREAD_COLOR);
+    return !OutFrame.empty();
+}
+
+bool FImageSequenceFrameSource::SkipNextFrame()
+{
+    if (NextFrameIndex >= FramePaths.Num())
+    {
+        if (!bLoop)
+        {
+            return false;
+        }
+        NextFrameIndex = 0;
+    }
+
+    NextFrameIndex++;
+    return true;
+}
@@ -0,0 +1,256 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PreOpenCVHeaders.h"
+#include "opencv2/opencv.hpp"
+#include "PostOpenCVHeaders.h"
+
+#include "FaceFrameSource.generated.h"
+
+
+UENUM(BlueprintType)
+enum class EFaceFrameSourceType : uint8
+{
+	Camera          UMETA(DisplayName = "Camera"),
+	VideoFile       UMETA(DisplayName = "Video File"),
+	ImageSequence   UMETA(DisplayName = "PNG Sequence")
+};
+
+
+UENUM(BlueprintType)
+enum class EFaceCameraFormat : uint8
+{
+	// Let the driver decode to BGR
+	Bgr     UMETA(DisplayName = "BGR"),
+	// GREY or YUYV, luma is read straight from the raw buffer
+	Luma    UMETA(DisplayName = "Luma (GREY/YUYV)"),
+	// Compressed MJPEG, decoded to grayscale at reduced scale for detection and in full only for the preview
+	Mjpeg   UMETA(DisplayName = "MJPEG")
+};
+
+
+// Lifecycle of a shared webcam, driven by its broker's capture thread
+UENUM(BlueprintType)
+enum class EFaceCameraState : uint8
+{
+	// No subscribers, the device is released
+	Closed      UMETA(DisplayName = "Closed"),
+	// First attempt to open the device
+	Opening     UMETA(DisplayName = "Opening"),
+	Streaming   UMETA(DisplayName = "Streaming"),
+	// Open failed or the device stopped delivering, waiting out the backoff before reopening
+	Lost        UMETA(DisplayName = "Lost"),
+	Reopening   UMETA(DisplayName = "Reopening")
+};
+
+
+// Layout of the frames a source delivers
+enum class EFaceFrameFormat : uint8
+{
+	Bgr,
+	// CV_8UC1
+	Grey,
+	// CV_8UC2, Y in channel 0
+	Yuyv,
+	// One row of compressed JPEG bytes
+	Mjpeg
+};
+
+
+UENUM(BlueprintType)
+enum class EFaceFramePacing : uint8
+{
+	// Frames are delivered at the source frame rate
+	RealTime            UMETA(DisplayName = "Real Time"),
+	// Frames are delivered as soon as they are read, for benchmarks and offline runs
+	AsFastAsPossible    UMETA(DisplayName = "As Fast As Possible")
+};
+
+
+USTRUCT(BlueprintType)
+struct FFaceFrameSourceSettings
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture")
+	EFaceFrameSourceType SourceType = EFaceFrameSourceType::Camera;
+
+	// Webcam device index
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture", meta = (EditCondition = "SourceType == EFaceFrameSourceType::Camera"))
+	int32 CameraIndex = 0;
+
+	// Format asked of the camera, skipping the driver's full-resolution BGR decode.
+	// Cameras without MJPEG fall back to luma, cameras with neither keep delivering BGR
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture", meta = (EditCondition = "SourceType == EFaceFrameSourceType::Camera"))
+	EFaceCameraFormat CameraFormat = EFaceCameraFormat::Luma;
+
+	// Video file, or folder of PNG frames. Relative paths are resolved against the project directory
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture", meta = (EditCondition = "SourceType != EFaceFrameSourceType::Camera"))
+	FString SourcePath;
+
+	// Replay timing for recorded sources
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture", meta = (EditCondition = "SourceType != EFaceFrameSourceType::Camera"))
+	EFaceFramePacing Pacing = EFaceFramePacing::RealTime;
+
+	// Frame rate of a PNG sequence
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture", meta = (EditCondition = "SourceType == EFaceFrameSourceType::ImageSequence", ClampMin = 1, ClampMax = 120))
+	float SequenceFrameRate = 30.0f;
+
+	// Restart recorded sources when they run out of frames
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture", meta = (EditCondition = "SourceType != EFaceFrameSourceType::Camera"))
+	bool bLoop = true;
+};
+
+
+// Supplies frames to the processing thread. Frames are BGR, except for cameras opened in a raw format,
+// see GetFrameFormat
+class IFaceFrameSource
+{
+public:
+	virtual ~IFaceFrameSource() {}
+
+	// Open the source, returns false if it can't be read
+	virtual bool Open() = 0;
+	virtual void Close() = 0;
+	virtual bool IsOpen() const = 0;
+
+	// False while an open is still completing in the background. Frame size, rate and format are only valid once true
+	virtual bool IsStreaming() const { return IsOpen(); }
+
+	// Read the next frame. Real time sources block until the frame is due
+	virtual bool ReadFrame(cv::Mat& OutFrame) = 0;
+
+	// Make a ReadFrame blocked on another thread return false straight away, or the next one if none is waiting.
+	// Sources that can't interrupt a read ignore this. Safe to call from any thread
+	virtual void CancelRead() {}
+
+	// Discard up to MaxFrames frames that are already overdue without decoding them, returns the number dropped
+	virtual int32 DropStaleFrames(int32 MaxFrames) = 0;
+
+	// Timestamp of the last frame read, in seconds since Open()
+	virtual double GetFrameTime() const = 0;
+
+	// What the source actually delivers, valid once it is streaming. The size, rate and format asked for are only
+	// requests: a device may not support them and a shared webcam keeps its first subscriber's, so consumers go by these
+	virtual FIntPoint GetFrameSize() const = 0;
+	virtual float GetFrameRate() const = 0;
+	// Format of the last frame read, it can change when a webcam reconnects
+	virtual EFaceFrameFormat GetFrameFormat() const { return EFaceFrameFormat::Bgr; }
+
+	virtual FString GetDescription() const = 0;
+
+	// Create the backend selected in the settings. Cameras are asked for the requested size and rate
+	static TUniquePtr<IFaceFrameSource> Create(const FFaceFrameSourceSettings& Settings, FIntPoint RequestedSize, float RequestedFrameRate);
+};
+
+
+// Live webcam
+class FCameraFrameSource : public IFaceFrameSource
+{
+public:
+	FCameraFrameSource(int32 InCameraIndex, FIntPoint InRequestedSize, float InRequestedFrameRate, EFaceCameraFormat InRequestedFormat);
+	virtual ~FCameraFrameSource();
+
+	virtual bool Open() override;
+	virtual void Close() override;
+	virtual bool IsOpen() const override;
+	virtual bool ReadFrame(cv::Mat& OutFrame) override;
+	virtual int32 DropStaleFrames(int32 MaxFrames) override;
+	virtual double GetFrameTime() const override { return FrameTime; }
+	virtual FIntPoint GetFrameSize() const override { return FrameSize; }
+	virtual float GetFrameRate() const override { return FrameRate; }
+	virtual EFaceFrameFormat GetFrameFormat() const override { return FrameFormat; }
+	virtual FString GetDescription() const override;
+
+private:
+	cv::VideoCapture VideoCapture;
+	int32 CameraIndex;
+	FIntPoint FrameSize;
+	float FrameRate;
+	EFaceCameraFormat RequestedFormat;
+	EFaceFrameFormat FrameFormat = EFaceFrameFormat::Bgr;
+	double OpenTime = 0.0;
+	double FrameTime = 0.0;
+
+	// Switch to a raw format with BGR conversion off, returns false if the camera doesn't offer it
+	bool NegotiateRawFormat(int32 FourCC, EFaceFrameFormat Format);
+};
+
+
+// Shared timing for recorded sources. Frame N is due at N / FrameRate seconds after the first frame
+class FRecordedFrameSource : public IFaceFrameSource
+{
+public:
+	FRecordedFrameSource(const FString& InPath, EFaceFramePacing InPacing, bool bInLoop);
+
+	virtual bool ReadFrame(cv::Mat& OutFrame) override;
+	virtual int32 DropStaleFrames(int32 MaxFrames) override;
+	virtual double GetFrameTime() const override;
+	virtual FIntPoint GetFrameSize() const override { return FrameSize; }
+	virtual float GetFrameRate() const override { return FrameRate; }
+
+protected:
+	// Read the next frame in file order, rewinding when looping. Returns false at the end of the source
+	virtual bool ReadNextFrame(cv::Mat& OutFrame) = 0;
+
+	// Skip the next frame in file order without decoding it, rewinding when looping
+	virtual bool SkipNextFrame() = 0;
+
+	// Reset timing, call from Open()
+	void ResetPacing();
+
+	FString Path;
+	EFaceFramePacing Pacing;
+	bool bLoop;
+	FIntPoint FrameSize = FIntPoint::ZeroValue;
+	float FrameRate = 30.0f;
+
+private:
+	int64 FramesRead = 0;
+	double PlaybackStartTime = 0.0;
+};
+
+
+// Video file replay through cv::VideoCapture
+class FVideoFileFrameSource : public FRecordedFrameSource
+{
+public:
+	FVideoFileFrameSource(const FString& InPath, EFaceFramePacing InPacing, bool bInLoop);
+	virtual ~FVideoFileFrameSource();
+
+	virtual bool Open() override;
+	virtual void Close() override;
+	virtual bool IsOpen() const override;
+	virtual FString GetDescription() const override;
+
+protected:
+	virtual bool ReadNextFrame(cv::Mat& OutFrame) override;
+	virtual bool SkipNextFrame() override;
+
+private:
+	cv::VideoCapture VideoCapture;
+};
+
+
+// Folder of PNG frames replayed in file name order
+class FImageSequenceFrameSource : public FRecordedFrameSource
+{
+public:
+	FImageSequenceFrameSource(const FString& InPath, float InFrameRate, EFaceFramePacing InPacing, bool bInLoop);
+
+	virtual bool Open() override;
+	virtual void Close() override;
+	virtual bool IsOpen() const override;
+	virtual FString GetDescription() const override;
+
+protected:
+	virtual bool ReadNextFrame(cv::Mat& OutFrame) override;
+	virtual bool SkipNextFrame() override;
+
+private:
+	TArray<FString> FramePaths;
+	int32 NextFrameIndex = 0;
+};
@@ -0,0 +1,87 @@
+
+#include "FaceLandmarks.h"
+#include "FaceDetector.h"
+
+
+FDnnFaceLandmarker::FDnnFaceLandmarker(const FString& InModelPath, int32 InInputSize)
+: ModelPath(InModelPath)
+, InputSize(FMath::Max(InInputSize, 32))
+{
+}
+
+bool FDnnFaceLandmarker::Load()
+{
+    Net = LoadDnnNet(ModelPath, FString(), TEXT("landmark model"));
+    if (Net.empty())
+    {
+        return false;
+    }
+
+    // Check the output shape once with a blank face, a model that doesn't return 68 points would
+    // otherwise feed zeros to the geometric rules on every frame
+    size_t ValuesPerFace = 0;
+    try
+    {
+        const int32 BlobShape[] = { 1, 3, InputSize, InputSize };
+        Net.setInput(cv::Mat(4, BlobShape, CV_32F, cv::Scalar(0.0f)));
+        Net.forward(OutputBlob);
+        ValuesPerFace = OutputBlob.total();
+    }
+    catch (const cv::Exception& Exception)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Landmark model %s rejected a %dx%d input: %s"), *ModelPath, InputSize, InputSize, UTF8_TO_TCHAR(Exception.what()));
+    }
+
+    if (ValuesPerFace < (size_t)NumLandmarks * 2)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Landmark model %s returns %d values per face, %d x, y pairs are needed"), *ModelPath, (int32)ValuesPerFace, NumLandmarks);
+        Net = cv::dnn::Net();
+        return false;
+    }
+
+    UE_LOG(LogTemp, Log, TEXT("Landmark model loaded successfully (%dx%d input)"), InputSize, InputSize);
+    return true;
+}
+
+void FDnnFaceLandmarker::Fit(const cv::Mat& GrayFrame, const std::vector<cv::Rect>& Faces, TArray<FVector2f>& OutLandmarks)
+{
+    const int32 NumFaces = Faces.size();
+    OutLandmarks.SetNumUninitialized(NumFaces * NumLandmarks);
+    if (NumFaces == 0)
+    {
+        return;
+    }
+
+    // Regressors are trained on colour crops, replicate the grayscale face into three channels
+    const cv::Size CropSize(InputSize, InputSize);
+    Crops.resize(NumFaces);
+    for (int32 FaceIndex = 0; FaceIndex < NumFaces; FaceIndex++)
+    {
+        cv::resize(GrayFrame(Faces[FaceIndex]), Crops[FaceIndex], CropSize, 0.0, 0.0, cv::INTER_AREA);
+        cv::cvtColor(Crops[FaceIndex], Crops[FaceIndex], cv::COLOR_GRAY2BGR);
+    }
+    cv::dnn::blobFromImages(Crops, InputBlob, 1.0 / 255.0, CropSize, cv::Scalar(), false, false);
+
+    Net.setInput(InputBlob);
+    Net.forward(OutputBlob);
+
+    // x, y pairs per face, normalised to the crop. Load has checked the shape, this only guards against batching surprises
+    const int32 ValuesPerFace = OutputBlob.total() / NumFaces;
+    if (ValuesPerFace < NumLandmarks * 2)
+    {
+        OutLandmarks.SetNumZeroed(NumFaces * NumLandmarks);
+        return;
+    }
+
+    for (int32 FaceIndex = 0; FaceIndex < NumFaces; FaceIndex++)
+    {
+        const cv::Rect& Face = Faces[FaceIndex];
+        const float* Points = OutputBlob.ptr<float>() + FaceIndex * ValuesPerFace;
+        for (int32 Landmark = 0; Landmark < NumLandmarks; Landmark++)
+        {
+            OutLandmarks[FaceIndex * NumLandmarks + Landmark] = FVector2f(
+                Face.x + Points[Landmark * 2] * Face.width,
+                Face.y + Points[Landmark * 2 + 1] * Face.height);
+        }
+    }
+}
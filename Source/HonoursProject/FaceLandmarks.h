@@ -0,0 +1,38 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PreOpenCVHeaders.h"
+#include "opencv2/opencv.hpp"
+#include "opencv2/dnn.hpp"
+#include "PostOpenCVHeaders.h"
+
+
+// Fits the 68-point iBUG landmark layout to face crops with a CNN regressor through cv::dnn.
+// Not thread safe, used by the classification stage only
+class FDnnFaceLandmarker
+{
+public:
+	static constexpr int32 NumLandmarks = 68;
+
+	FDnnFaceLandmarker(const FString& InModelPath, int32 InInputSize);
+
+	// Load the model and check it returns NumLandmarks points, logs and returns false on failure
+	bool Load();
+
+	// Fit every face of a frame in a single forward pass. OutLandmarks gets NumLandmarks points per face, in frame pixels
+	void Fit(const cv::Mat& GrayFrame, const std::vector<cv::Rect>& Faces, TArray<FVector2f>& OutLandmarks);
+
+private:
+	FString ModelPath;
+	int32 InputSize;
+
+	cv::dnn::Net Net;
+
+	// Reused between frames
+	std::vector<cv::Mat> Crops;
+	cv::Mat InputBlob;
+	cv::Mat OutputBlob;
+};
@@ -0,0 +1,206 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FaceModelSubsystem.h"
+#include "Async/Async.h"
+#include "HAL/IConsoleManager.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+
+CSV_DECLARE_CATEGORY_EXTERN(FaceTracker);
+
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Model Load (ms)"), STAT_FaceTracker_ModelLoadMs, STATGROUP_FaceTracker);
+
+
+static TAutoConsoleVariable<bool> CVarFaceTrackerPreloadModels(
+    TEXT("FaceTracker.PreloadModels"),
+    true,
+    TEXT("Start loading the default face tracker models when the game instance starts, before any tracker spawns"));
+
+// Loads run on pool threads, possibly several at once
+static std::atomic<float> GFaceModelLastLoadMs(0.0f);
+
+void UFaceModelSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+    
+    if (!CVarFaceTrackerPreloadModels.GetValueOnGameThread())
+    {
+        return;
+    }
+    
+    if (PreloadTrackerClasses.Num() == 0)
+    {
+        StartPreloads({ GetDefault<AFaceTracker>() });
+        return;
+    }
+    
+    // Tracker Blueprints are streamed in rather than loaded on the game thread, the models follow from the callback
+    TArray<FSoftObjectPath> ClassPaths;
+    for (const TSoftClassPtr<AFaceTracker>& TrackerClass : PreloadTrackerClasses)
+    {
+        ClassPaths.Add(TrackerClass.ToSoftObjectPath());
+    }
+    PreloadClassesHandle = StreamableManager.RequestAsyncLoad(ClassPaths, FStreamableDelegate::CreateUObject(this, &UFaceModelSubsystem::OnPreloadClassesLoaded));
+    if (!PreloadClassesHandle)
+    {
+        OnPreloadClassesLoaded();
+    }
+}
+
+void UFaceModelSubsystem::OnPreloadClassesLoaded()
+{
+    TArray<const AFaceTracker*> Trackers;
+    for (const TSoftClassPtr<AFaceTracker>& TrackerClass : PreloadTrackerClasses)
+    {
+        if (UClass* Class = TrackerClass.Get())
+        {
+            Trackers.Add(Class->GetDefaultObject<AFaceTracker>());
+        }
+        else
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Failed to load face tracker class %s for preloading"), *TrackerClass.ToString());
+        }
+    }
+    if (Trackers.Num() == 0)
+    {
+        Trackers.Add(GetDefault<AFaceTracker>());
+    }
+    
+    StartPreloads(Trackers);
+    PreloadClassesHandle.Reset();
+}
+
+void UFaceModelSubsystem::StartPreloads(const TArray<const AFaceTracker*>& Trackers)
+{
+    for (const AFaceTracker* Tracker : Trackers)
+    {
+        const FFaceModelConfig Config = Tracker->GetModelConfig();
+        const FString Key = Config.GetKey();
+        if (!PreloadedModels.Contains(Key) && !AcquiredKeys.Contains(Key))
+        {
+            PreloadedModels.Add(Key, StartLoad(Config));
+        }
+    }
+    bPreloadsStarted = true;
+}
+
+void UFaceModelSubsystem::Deinitialize()
+{
+    if (PreloadClassesHandle)
+    {
+        PreloadClassesHandle->CancelHandle();
+        PreloadClassesHandle.Reset();
+    }
+    
+    // The loads only touch their own model set, but they must not outlive the module
+    for (const TSharedFuture<FFaceTrackerModelsPtr>& Load : PendingLoads)
+    {
+        Load.Wait();
+    }
+    PendingLoads.Empty();
+    PreloadedModels.Empty();
+    FreeModels.Empty();
+    
+    Super::Deinitialize();
+}
+
+TSharedFuture<FFaceTrackerModelsPtr> UFaceModelSubsystem::AcquireModels(const FFaceModelConfig& Config)
+{
+    check(IsInGameThread());
+    
+    PendingLoads.RemoveAll([](const TSharedFuture<FFaceTrackerModelsPtr>& Load) { return Load.IsReady(); });
+    CollectPreloads();
+    
+    const FString Key = Config.GetKey();
+    AcquiredKeys.Add(Key);
+    if (const FFaceTrackerModelsPtr* Free = FreeModels.Find(Key))
+    {
+        FFaceTrackerModelsPtr Models = *Free;
+        FreeModels.RemoveSingle(Key, Models);
+        UE_LOG(LogTemp, Log, TEXT("Reusing cached face tracker models"));
+        return MakeFulfilledPromise<FFaceTrackerModelsPtr>(MoveTemp(Models)).GetFuture().Share();
+    }
+    
+    TSharedFuture<FFaceTrackerModelsPtr> Preloaded;
+    if (PreloadedModels.RemoveAndCopyValue(Key, Preloaded))
+    {
+        return Preloaded;
+    }
+    
+    // A tracker that spawns while the preload classes are still streaming in loads its own set, and the preload skips it
+    if (bPreloadsStarted)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Face tracker models weren't preloaded, add the tracker's class to PreloadTrackerClasses"));
+    }
+    return StartLoad(Config);
+}
+
+void UFaceModelSubsystem::ReleaseModels(const FFaceModelConfig& Config, FFaceTrackerModelsPtr Models)
+{
+    check(IsInGameThread());
+    
+    if (Models)
+    {
+        FreeModels.Add(Config.GetKey(), MoveTemp(Models));
+    }
+    CollectPreloads();
+}
+
+void UFaceModelSubsystem::CollectPreloads()
+{
+    for (auto It = PreloadedModels.CreateIterator(); It; ++It)
+    {
+        if (!It.Value().IsReady())
+        {
+            continue;
+        }
+        
+        if (FFaceTrackerModelsPtr Models = It.Value().Get())
+        {
+            FreeModels.Add(It.Key(), MoveTemp(Models));
+        }
+        It.RemoveCurrent();
+    }
+}
+
+float UFaceModelSubsystem::GetLastLoadMs() const
+{
+    return GFaceModelLastLoadMs.load();
+}
+
+TSharedFuture<FFaceTrackerModelsPtr> UFaceModelSubsystem::StartLoad(const FFaceModelConfig& Config)
+{
+    TSharedFuture<FFaceTrackerModelsPtr> Load = Async(EAsyncExecution::ThreadPool, [Config]()
+    {
+        return LoadModels(Config);
+    }).Share();
+    PendingLoads.Add(Load);
+    return Load;
+}
+
+FFaceTrackerModelsPtr UFaceModelSubsystem::LoadModels(const FFaceModelConfig& Config)
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FaceTracker_LoadModels);
+    const double StartTime = FPlatformTime::Seconds();
+    
+    FFaceTrackerModelsPtr Models = MakeShared<FFaceTrackerModels, ESPMode::ThreadSafe>();
+    FFaceDetectorConfig DetectorConfig = Config.Detector;
+    FEmotionClassifierSettings ClassifierSettings = Config.Classifier;
+    if (!Models->Load(DetectorConfig, ClassifierSettings, Config.EyeCascadePath, Config.SmileCascadePath, Config.NumFeatureSlots)
+        && (DetectorConfig.Backend != EFaceDetectorBackend::HaarCascade || ClassifierSettings.Backend != EEmotionClassifierBackend::HaarFeatures))
+    {
+        // A missing DNN model shouldn't take face tracking down with it
+        UE_LOG(LogTemp, Warning, TEXT("Falling back to Haar cascades"));
+        DetectorConfig.Backend = EFaceDetectorBackend::HaarCascade;
+        ClassifierSettings.Backend = EEmotionClassifierBackend::HaarFeatures;
+        Models->Load(DetectorConfig, ClassifierSettings, Config.EyeCascadePath, Config.SmileCascadePath, Config.NumFeatureSlots);
+    }
+    
+    const float LoadMs = (float)((FPlatformTime::Seconds() - StartTime) * 1000.0);
+    GFaceModelLastLoadMs.store(LoadMs);
+    SET_FLOAT_STAT(STAT_FaceTracker_ModelLoadMs, LoadMs);
+    CSV_CUSTOM_STAT(FaceTracker, ModelLoadMs, LoadMs, ECsvCustomStatOp::Set);
+    UE_LOG(LogTemp, Log, TEXT("Loaded face tracker models in %.1f ms"), LoadMs);
+    return Models;
+}
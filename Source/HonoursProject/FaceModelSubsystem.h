@@ -0,0 +1,70 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "Async/Future.h"
+#include "Engine/StreamableManager.h"
+
+#include "FaceTracker.h"
+
+#include "FaceModelSubsystem.generated.h"
+
+
+// Loads face tracker models on the thread pool and keeps them for the lifetime of the game instance,
+// so level transitions and respawned trackers reuse them instead of parsing the cascades and networks again.
+// A model set is lent to one tracker at a time as the detectors and classifiers are not thread safe.
+// Only trackers matching one of PreloadTrackerClasses skip the load on their first BeginPlay.
+// Those classes are streamed in asynchronously, their model loads start once they arrive
+UCLASS(Config = Game)
+class HONOURSPROJECT_API UFaceModelSubsystem : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	
+	// A free cached set for Config if there is one, otherwise a load in the background. Game thread only
+	TSharedFuture<FFaceTrackerModelsPtr> AcquireModels(const FFaceModelConfig& Config);
+	
+	// Hand a set from AcquireModels back to the cache once its tracker has stopped using it
+	void ReleaseModels(const FFaceModelConfig& Config, FFaceTrackerModelsPtr Models);
+	
+	// Wall time of the most recent load
+	UFUNCTION(BlueprintPure, Category = "Facial Tracking")
+	float GetLastLoadMs() const;
+	
+	// Load synchronously, falling back to Haar cascades if a DNN model is missing. Safe on any thread
+	static FFaceTrackerModelsPtr LoadModels(const FFaceModelConfig& Config);
+
+private:
+	TSharedFuture<FFaceTrackerModelsPtr> StartLoad(const FFaceModelConfig& Config);
+	
+	// Start a load for each tracker whose model set nobody has asked for yet
+	void StartPreloads(const TArray<const AFaceTracker*>& Trackers);
+	void OnPreloadClassesLoaded();
+	
+	// Move finished preloads nobody claimed yet into FreeModels
+	void CollectPreloads();
+	
+	// Trackers whose models start loading in Initialize, the native AFaceTracker defaults if empty.
+	// List the tracker Blueprints placed in levels, as their model settings may differ from the native defaults
+	UPROPERTY(Config)
+	TArray<TSoftClassPtr<AFaceTracker>> PreloadTrackerClasses;
+	
+	FStreamableManager StreamableManager;
+	TSharedPtr<FStreamableHandle> PreloadClassesHandle;
+	// Set once PreloadTrackerClasses have loaded and their preloads started
+	bool bPreloadsStarted = false;
+	// Every config a tracker has acquired, so a preload arriving late doesn't load the same set again
+	TSet<FString> AcquiredKeys;
+	
+	// Loaded sets nobody is using, keyed by FFaceModelConfig::GetKey
+	TMultiMap<FString, FFaceTrackerModelsPtr> FreeModels;
+	// Started in Initialize before any tracker asked for them
+	TMap<FString, TSharedFuture<FFaceTrackerModelsPtr>> PreloadedModels;
+	// Every load started, waited on in Deinitialize
+	TArray<TSharedFuture<FFaceTrackerModelsPtr>> PendingLoads;
+};
@@ -0,0 +1,83 @@
+
+#include "FacePipelineProfiling.h"
+
+DEFINE_STAT(STAT_FaceTracker_Capture);
+DEFINE_STAT(STAT_FaceTracker_Decode);
+DEFINE_STAT(STAT_FaceTracker_GrayConvert);
+DEFINE_STAT(STAT_FaceTracker_Resize);
+DEFINE_STAT(STAT_FaceTracker_Equalize);
+DEFINE_STAT(STAT_FaceTracker_Mirror);
+DEFINE_STAT(STAT_FaceTracker_DetectFaces);
+DEFINE_STAT(STAT_FaceTracker_TrackFaces);
+DEFINE_STAT(STAT_FaceTracker_AssociateFaces);
+DEFINE_STAT(STAT_FaceTracker_DetectEyes);
+DEFINE_STAT(STAT_FaceTracker_DetectSmile);
+DEFINE_STAT(STAT_FaceTracker_FitLandmarks);
+DEFINE_STAT(STAT_FaceTracker_Classify);
+DEFINE_STAT(STAT_FaceTracker_Upload);
+DEFINE_STAT(STAT_FaceTracker_Frame);
+
+
+const TCHAR* GetFacePipelineStageName(EFacePipelineStage Stage)
+{
+    switch (Stage)
+    {
+        case EFacePipelineStage::Capture:       return TEXT("Capture");
+        case EFacePipelineStage::Decode:        return TEXT("Decode");
+        case EFacePipelineStage::GrayConvert:   return TEXT("GrayConvert");
+        case EFacePipelineStage::Resize:        return TEXT("Resize");
+        case EFacePipelineStage::Equalize:      return TEXT("Equalize");
+        case EFacePipelineStage::Mirror:        return TEXT("Mirror");
+        case EFacePipelineStage::DetectFaces:   return TEXT("DetectFaces");
+        case EFacePipelineStage::TrackFaces:    return TEXT("TrackFaces");
+        case EFacePipelineStage::AssociateFaces: return TEXT("AssociateFaces");
+        case EFacePipelineStage::DetectEyes:    return TEXT("DetectEyes");
+        case EFacePipelineStage::DetectSmile:   return TEXT("DetectSmile");
+        case EFacePipelineStage::FitLandmarks:  return TEXT("FitLandmarks");
+        case EFacePipelineStage::Classify:      return TEXT("Classify");
+        case EFacePipelineStage::Upload:        return TEXT("Upload");
+        case EFacePipelineStage::Frame:         return TEXT("Frame");
+        default:                                return TEXT("Unknown");
+    }
+}
+
+FFacePipelineTimings::FFacePipelineTimings()
+{
+    BeginFrame();
+}
+
+void FFacePipelineTimings::BeginFrame()
+{
+    for (int32 Stage = 0; Stage < NumStages; Stage++)
+    {
+        FrameCycles[Stage].store(0, std::memory_order_relaxed);
+        FrameCalls[Stage].store(0, std::memory_order_relaxed);
+    }
+}
+
+void FFacePipelineTimings::AddCycles(EFacePipelineStage Stage, uint64 Cycles)
+{
+    FrameCycles[(int32)Stage].fetch_add(Cycles, std::memory_order_relaxed);
+    FrameCalls[(int32)Stage].fetch_add(1, std::memory_order_relaxed);
+}
+
+void FFacePipelineTimings::EndFrame()
+{
+    for (int32 Stage = 0; Stage < NumStages; Stage++)
+    {
+        // Stages that didn't run, e.g. eyes with no face in view, don't count as zero-cost samples
+        if (FrameCalls[Stage].load(std::memory_order_relaxed) > 0)
+        {
+            Samples[Stage].Add(FPlatformTime::ToMilliseconds64(FrameCycles[Stage].load(std::memory_order_relaxed)));
+        }
+    }
+}
+
+void FFacePipelineTimings::Reset()
+{
+    for (int32 Stage = 0; Stage < NumStages; Stage++)
+    {
+        Samples[Stage].Reset();
+    }
+    BeginFrame();
+}
@@ -0,0 +1,119 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+#include <atomic>
+
+
+// Timed stages of FVideoProcessingThread::ProcessFrame
+enum class EFacePipelineStage : uint8
+{
+	Capture,
+	// Compressed camera frames to luma
+	Decode,
+	GrayConvert,
+	Resize,
+	Equalize,
+	// Mirroring the small detection frame
+	Mirror,
+	DetectFaces,
+	TrackFaces,
+	AssociateFaces,
+	DetectEyes,
+	DetectSmile,
+	FitLandmarks,
+	Classify,
+	Upload,
+	// Whole frame, capture included
+	Frame,
+	Count
+};
+
+const TCHAR* GetFacePipelineStageName(EFacePipelineStage Stage);
+
+
+// stat FaceTracker, one cycle counter per EFacePipelineStage
+DECLARE_STATS_GROUP(TEXT("FaceTracker"), STATGROUP_FaceTracker, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Capture"), STAT_FaceTracker_Capture, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Decode"), STAT_FaceTracker_Decode, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("GrayConvert"), STAT_FaceTracker_GrayConvert, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Resize"), STAT_FaceTracker_Resize, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Equalize"), STAT_FaceTracker_Equalize, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Mirror"), STAT_FaceTracker_Mirror, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DetectFaces"), STAT_FaceTracker_DetectFaces, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("TrackFaces"), STAT_FaceTracker_TrackFaces, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("AssociateFaces"), STAT_FaceTracker_AssociateFaces, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DetectEyes"), STAT_FaceTracker_DetectEyes, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("DetectSmile"), STAT_FaceTracker_DetectSmile, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("FitLandmarks"), STAT_FaceTracker_FitLandmarks, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Classify"), STAT_FaceTracker_Classify, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Upload"), STAT_FaceTracker_Upload, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Frame"), STAT_FaceTracker_Frame, STATGROUP_FaceTracker, HONOURSPROJECT_API);
+
+
+// Per-frame stage timings collected by the benchmark.
+// Stages may be timed from several threads, their cost is summed per frame.
+class FFacePipelineTimings
+{
+public:
+	FFacePipelineTimings();
+
+	// Clear the per-frame accumulators, call before processing a frame
+	void BeginFrame();
+
+	// Thread safe
+	void AddCycles(EFacePipelineStage Stage, uint64 Cycles);
+
+	// Record one sample per stage that ran during the frame
+	void EndFrame();
+
+	// Drop all samples, e.g. after warm-up
+	void Reset();
+
+	// Per-frame stage costs in milliseconds
+	const TArray<double>& GetSamples(EFacePipelineStage Stage) const { return Samples[(int32)Stage]; }
+
+private:
+	static constexpr int32 NumStages = (int32)EFacePipelineStage::Count;
+
+	std::atomic<uint64> FrameCycles[NumStages];
+	std::atomic<uint32> FrameCalls[NumStages];
+	TArray<double> Samples[NumStages];
+};
+
+
+// Adds the time spent in a scope to the timings, if any are attached
+class FFacePipelineStageScope
+{
+public:
+	FFacePipelineStageScope(FFacePipelineTimings* InTimings, EFacePipelineStage InStage)
+		: Timings(InTimings)
+		, Stage(InStage)
+		, StartCycles(InTimings ? FPlatformTime::Cycles64() : 0)
+	{
+	}
+
+	~FFacePipelineStageScope()
+	{
+		if (Timings)
+		{
+			Timings->AddCycles(Stage, FPlatformTime::Cycles64() - StartCycles);
+		}
+	}
+
+private:
+	FFacePipelineTimings* Timings;
+	EFacePipelineStage Stage;
+	uint64 StartCycles;
+};
+
+// Times a stage for the benchmark, the FaceTracker stat group and Unreal Insights
+#define FACE_PIPELINE_SCOPE(Timings, Stage) \
+	TRACE_CPUPROFILER_EVENT_SCOPE(FaceTracker_##Stage); \
+	FScopeCycleCounter PREPROCESSOR_JOIN(FaceStatScope_, __LINE__)(GET_STATID(STAT_FaceTracker_##Stage)); \
+	FFacePipelineStageScope PREPROCESSOR_JOIN(FacePipelineScope_, __LINE__)(Timings, EFacePipelineStage::Stage)
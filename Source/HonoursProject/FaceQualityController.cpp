@@ -0,0 +1,62 @@
+
+#include "FaceQualityController.h"
+
+
+bool FFaceQualityController::Update(const FFaceQualityPolicy& Policy, float DeltaTime, float GameThreadMs, float PipelineLatencyMs)
+{
+    const float PreviousQuality = Quality;
+    
+    if (!Policy.bEnabled)
+    {
+        Quality = 1.0f;
+        return Quality != PreviousQuality;
+    }
+    
+    ElapsedTime += DeltaTime;
+    TotalGameThreadMs += GameThreadMs;
+    TotalPipelineLatencyMs += PipelineLatencyMs;
+    NumSamples++;
+    
+    if (ElapsedTime < Policy.EvaluationInterval)
+    {
+        return false;
+    }
+    
+    // Whichever side is closest to its limit decides
+    const float AverageGameThreadMs = TotalGameThreadMs / NumSamples;
+    const float AveragePipelineLatencyMs = TotalPipelineLatencyMs / NumSamples;
+    const float Load = FMath::Max(AverageGameThreadMs / FMath::Max(Policy.GameFrameBudgetMs, 1.0f),
+        AveragePipelineLatencyMs / FMath::Max(Policy.MaxPipelineLatencyMs, 1.0f));
+    
+    if (Load > 1.0f)
+    {
+        Quality = FMath::Max(Quality - Policy.StepDown, 0.0f);
+    }
+    else if (Load < Policy.RecoverThreshold)
+    {
+        Quality = FMath::Min(Quality + Policy.StepUp, 1.0f);
+    }
+    
+    ElapsedTime = 0.0f;
+    TotalGameThreadMs = 0.0f;
+    TotalPipelineLatencyMs = 0.0f;
+    NumSamples = 0;
+    
+    return Quality != PreviousQuality;
+}
+
+FFaceQualityLevel FFaceQualityController::GetLevel(const FFaceQualityPolicy& Policy, float InQuality)
+{
+    const FFaceQualityLevel& Low = Policy.LowQuality;
+    const FFaceQualityLevel& High = Policy.HighQuality;
+    const float Alpha = FMath::Clamp(InQuality, 0.0f, 1.0f);
+    
+    FFaceQualityLevel Level;
+    const float ScaleSteps = (float)(FMath::Max(Policy.DetectionScaleLevels, 2) - 1);
+    Level.DetectionScale = FMath::Lerp(Low.DetectionScale, High.DetectionScale, FMath::RoundToFloat(Alpha * ScaleSteps) / ScaleSteps);
+    Level.ScaleFactor = FMath::Lerp(Low.ScaleFactor, High.ScaleFactor, Alpha);
+    Level.MinNeighbors = FMath::RoundToInt(FMath::Lerp((float)Low.MinNeighbors, (float)High.MinNeighbors, Alpha));
+    Level.FeatureInterval = FMath::Max(1, FMath::RoundToInt(FMath::Lerp((float)Low.FeatureInterval, (float)High.FeatureInterval, Alpha)));
+    Level.FrameRateScale = FMath::Lerp(Low.FrameRateScale, High.FrameRateScale, Alpha);
+    return Level;
+}
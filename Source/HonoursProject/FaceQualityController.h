@@ -0,0 +1,113 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "FaceQualityController.generated.h"
+
+
+// Cost knobs of the face pipeline at one quality level
+USTRUCT(BlueprintType)
+struct FFaceQualityLevel
+{
+	GENERATED_BODY()
+	
+	// Downscale applied to the grayscale frame before face detection
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality", meta = (ClampMin = 0.1, ClampMax = 1))
+	float DetectionScale = 0.5f;
+	
+	// Face cascade pyramid step, larger is faster but misses more faces
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality", meta = (ClampMin = 1.01, ClampMax = 2))
+	float ScaleFactor = 1.1f;
+	
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality", meta = (ClampMin = 1, ClampMax = 10))
+	int32 MinNeighbors = 3;
+	
+	// Frames between two emotion classifications, faces keep their last result in between
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality", meta = (ClampMin = 1, ClampMax = 30))
+	int32 FeatureInterval = 1;
+	
+	// Fraction of TargetFPS the worker runs at
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality", meta = (ClampMin = 0.1, ClampMax = 1))
+	float FrameRateScale = 1.0f;
+};
+
+
+// How the face pipeline trades quality for CPU time
+USTRUCT(BlueprintType)
+struct FFaceQualityPolicy
+{
+	GENERATED_BODY()
+	
+	FFaceQualityPolicy()
+	{
+		LowQuality.DetectionScale = 0.25f;
+		LowQuality.ScaleFactor = 1.3f;
+		LowQuality.MinNeighbors = 2;
+		LowQuality.FeatureInterval = 4;
+		LowQuality.FrameRateScale = 0.34f;
+	}
+	
+	// Trade quality for CPU time under load. When off the pipeline stays at HighQuality regardless of load
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality")
+	bool bEnabled = true;
+	
+	// Game thread time per frame above which the pipeline backs off
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality", meta = (EditCondition = "bEnabled", ClampMin = 1))
+	float GameFrameBudgetMs = 16.6f;
+	
+	// Capture to result latency above which the pipeline backs off
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality", meta = (EditCondition = "bEnabled", ClampMin = 1))
+	float MaxPipelineLatencyMs = 66.0f;
+	
+	// Quality only recovers once both measurements are below this fraction of their limit
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality", meta = (EditCondition = "bEnabled", ClampMin = 0, ClampMax = 1))
+	float RecoverThreshold = 0.8f;
+	
+	// Seconds of measurements averaged per adjustment
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality", meta = (EditCondition = "bEnabled", ClampMin = 0.1))
+	float EvaluationInterval = 0.5f;
+	
+	// Quality lost per adjustment when over budget, and regained when under. Backing off faster than recovering avoids oscillation
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality", meta = (EditCondition = "bEnabled", ClampMin = 0, ClampMax = 1))
+	float StepDown = 0.25f;
+	
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality", meta = (EditCondition = "bEnabled", ClampMin = 0, ClampMax = 1))
+	float StepUp = 0.05f;
+	
+	// Distinct detection scales between LowQuality and HighQuality, both included. A scale change drops all tracked
+	// faces, so the scale only moves when the quality crosses one of these levels rather than on every step
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality", meta = (EditCondition = "bEnabled", ClampMin = 2, ClampMax = 8))
+	int32 DetectionScaleLevels = 3;
+	
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality")
+	FFaceQualityLevel HighQuality;
+	
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Quality", meta = (EditCondition = "bEnabled"))
+	FFaceQualityLevel LowQuality;
+};
+
+
+// Runs on the game thread. Moves a quality value between 0 (LowQuality) and 1 (HighQuality)
+// from the measured game thread time and pipeline latency
+class FFaceQualityController
+{
+public:
+	// Feed one game frame, returns true when the quality changed and the worker should be updated
+	bool Update(const FFaceQualityPolicy& Policy, float DeltaTime, float GameThreadMs, float PipelineLatencyMs);
+
+	float GetQuality() const { return Quality; }
+
+	// Knobs for a quality between 0 and 1
+	static FFaceQualityLevel GetLevel(const FFaceQualityPolicy& Policy, float InQuality);
+
+private:
+	float Quality = 1.0f;
+
+	// Measurements since the last adjustment
+	float ElapsedTime = 0.0f;
+	float TotalGameThreadMs = 0.0f;
+	float TotalPipelineLatencyMs = 0.0f;
+	int32 NumSamples = 0;
+};
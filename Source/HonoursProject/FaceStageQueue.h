@@ -0,0 +1,91 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+
+#include <atomic>
+
+// Bounded lock-free single producer / single consumer queue between two pipeline stages.
+// Push and Pop never block, the Wait functions let a stage sleep until the other side acts.
+template<typename T>
+class TFaceStageQueue
+{
+public:
+	explicit TFaceStageQueue(uint32 InCapacity)
+		: Capacity(FMath::Max(InCapacity, 1u))
+		, Head(0)
+		, Tail(0)
+		, DataEvent(FPlatformProcess::GetSynchEventFromPool(false))
+		, SpaceEvent(FPlatformProcess::GetSynchEventFromPool(false))
+	{
+		Items.SetNum(Capacity);
+	}
+
+	~TFaceStageQueue()
+	{
+		FPlatformProcess::ReturnSynchEventToPool(DataEvent);
+		FPlatformProcess::ReturnSynchEventToPool(SpaceEvent);
+	}
+
+	// Producer: returns false if the queue is full
+	bool Push(T Item)
+	{
+		const uint64 CurrentTail = Tail.load(std::memory_order_relaxed);
+		if (CurrentTail - Head.load(std::memory_order_acquire) >= Capacity)
+		{
+			return false;
+		}
+
+		Items[(int32)(CurrentTail % Capacity)] = MoveTemp(Item);
+		Tail.store(CurrentTail + 1, std::memory_order_release);
+		DataEvent->Trigger();
+		return true;
+	}
+
+	// Consumer: returns false if the queue is empty
+	bool Pop(T& OutItem)
+	{
+		const uint64 CurrentHead = Head.load(std::memory_order_relaxed);
+		if (CurrentHead == Tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		OutItem = MoveTemp(Items[(int32)(CurrentHead % Capacity)]);
+		Head.store(CurrentHead + 1, std::memory_order_release);
+		SpaceEvent->Trigger();
+		return true;
+	}
+
+	// Producer: true if a Push would succeed
+	bool HasSpace() const
+	{
+		return Tail.load(std::memory_order_relaxed) - Head.load(std::memory_order_acquire) < Capacity;
+	}
+
+	// Consumer: sleep until something is pushed or the timeout expires
+	void WaitForData(uint32 TimeoutMs)
+	{
+		DataEvent->Wait(TimeoutMs);
+	}
+
+	// Producer: sleep until something is popped or the timeout expires
+	void WaitForSpace(uint32 TimeoutMs)
+	{
+		SpaceEvent->Wait(TimeoutMs);
+	}
+
+private:
+	const uint32 Capacity;
+	TArray<T> Items;
+
+	// Monotonic counters, the slot is the counter modulo Capacity
+	std::atomic<uint64> Head;
+	std::atomic<uint64> Tail;
+
+	FEvent* DataEvent;
+	FEvent* SpaceEvent;
+};
@@ -1,4 +1,26 @@
 #include "FaceTracker.h"
+#include "FaceModelSubsystem.h"
+#include "FaceCameraSubsystem.h"
+#include "FaceTrackerOverlay.h"
+#include "Engine/GameInstance.h"
+#include "RenderCore.h"
+#include "Async/ParallelFor.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "HAL/IConsoleManager.h"
+#include "Engine/Engine.h"
+#include "UObject/ConstructorHelpers.h"
+
+CSV_DEFINE_CATEGORY(FaceTracker, true);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Faces"), STAT_FaceTracker_Faces, STATGROUP_FaceTracker);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Pipeline Latency (ms)"), STAT_FaceTracker_LatencyMs, STATGROUP_FaceTracker);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Dropped Frames"), STAT_FaceTracker_DroppedFrames, STATGROUP_FaceTracker);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Cold Start (ms)"), STAT_FaceTracker_ColdStartMs, STATGROUP_FaceTracker);
+
+static TAutoConsoleVariable<bool> CVarFaceTrackerDebugHUD(
+    TEXT("FaceTracker.DebugHUD"),
+    false,
+    TEXT("Show face pipeline counters and the first face's features on screen"));
 
 
 AFaceTracker::AFaceTracker()
@@ -9,10 +31,19 @@ AFaceTracker::AFaceTracker()
     HaarCascadePath = FPaths::ProjectContentDir() + TEXT("HaarCascades/haarcascade_frontalface_default.xml");
     EyeCascadePath = FPaths::ProjectContentDir() + TEXT("HaarCascades/haarcascade_eye.xml");
     SmileCascadePath = FPaths::ProjectContentDir() + TEXT("HaarCascades/haarcascade_smile.xml");
+    DnnFaceModelPath = FPaths::ProjectContentDir() + TEXT("DnnModels/res10_300x300_ssd_iter_140000.caffemodel");
+    DnnFaceConfigPath = FPaths::ProjectContentDir() + TEXT("DnnModels/deploy.prototxt");
+    EmotionClassifier.ModelPath = FPaths::ProjectContentDir() + TEXT("DnnModels/emotion_fer.onnx");
+    EmotionClassifier.LandmarkModelPath = FPaths::ProjectContentDir() + TEXT("DnnModels/face_landmarks_68.onnx");
+    
+    static ConstructorHelpers::FObjectFinder<UMaterialInterface> VideoMaterialFinder(TEXT("/Game/EmotionBasedGaming/Materials/M_VideoDisplay.M_VideoDisplay"));
+    VideoMaterial = VideoMaterialFinder.Object;
+    VideoMaterialInstance = nullptr;
+    OverlayWidgetClass = nullptr;
+    OverlayWidget = nullptr;
     
     VideoWidth = 640;
     VideoHeight = 480;
-    VideoUpdateTextureRegion = nullptr;
     ProcessingThread = nullptr;
     Thread = nullptr;
     TimeSinceLastUpdate = 0.0f;
@@ -27,429 +58,1600 @@ void AFaceTracker::BeginPlay()
 	Super::BeginPlay();
     
     UE_LOG(LogTemp, Log, TEXT("Initializing Facial Expression Tracker..."));
+    BeginPlayTime = FPlatformTime::Seconds();
+    
+    // Replayed sessions are drawn too
+    if (OverlayWidgetClass)
+    {
+        SetOverlayVisible(true);
+    }
+    
+    // A recorded session needs neither camera nor models
+    if (!EmotionLog.ReplayPath.IsEmpty())
+    {
+        if (StartEmotionReplay())
+        {
+            return;
+        }
+        UE_LOG(LogTemp, Warning, TEXT("Falling back to the camera"));
+    }
     
-    // Initialize webcam
-    VideoCapture.open(0);
+    // Webcams are shared through the game instance and stay open across level transitions, recorded sources are per tracker
+    UGameInstance* GameInstance = GetGameInstance();
+    UFaceCameraSubsystem* CameraSubsystem = GameInstance ? GameInstance->GetSubsystem<UFaceCameraSubsystem>() : nullptr;
+    if (CameraSubsystem && CaptureSettings.SourceType == EFaceFrameSourceType::Camera)
+    {
+        FrameSource = CameraSubsystem->Subscribe(CaptureSettings, FIntPoint(VideoWidth, VideoHeight), TargetFPS);
+    }
+    else
+    {
+        FrameSource = IFaceFrameSource::Create(CaptureSettings, FIntPoint(VideoWidth, VideoHeight), TargetFPS);
+    }
     
-    if (!VideoCapture.isOpened())
+    // Only subscribes to a webcam, the broker opens and reconnects the device on its own thread
+    if (!FrameSource->Open())
     {
-        UE_LOG(LogTemp, Error, TEXT("Failed to open webcam"));
+        UE_LOG(LogTemp, Error, TEXT("Failed to open %s"), *FrameSource->GetDescription());
+        FrameSource.Reset();
         return;
     }
     
-    // Set webcam resolution
-    VideoCapture.set(cv::CAP_PROP_FRAME_WIDTH, VideoWidth);
-    VideoCapture.set(cv::CAP_PROP_FRAME_HEIGHT, VideoHeight);
-    VideoCapture.set(cv::CAP_PROP_FPS, TargetFPS);
-    VideoCapture.set(cv::CAP_PROP_BUFFERSIZE, 1); // Minimize buffering
+    if (CameraSubsystem && CaptureSettings.SourceType == EFaceFrameSourceType::Camera)
+    {
+        CameraStateHandle = CameraSubsystem->OnCameraStateChanged.AddUObject(this, &AFaceTracker::HandleCameraStateChanged);
+    }
+    
+    // Face detector and classifier come from the game instance's cache, loaded off the game thread.
+    // The worker starts on the first Tick they are ready and the camera is streaming
+    ModelConfig = GetModelConfig();
+    if (UFaceModelSubsystem* ModelSubsystem = GameInstance ? GameInstance->GetSubsystem<UFaceModelSubsystem>() : nullptr)
+    {
+        PendingModels = ModelSubsystem->AcquireModels(ModelConfig);
+    }
+    else
+    {
+        PendingModels = MakeFulfilledPromise<FFaceTrackerModelsPtr>(UFaceModelSubsystem::LoadModels(ModelConfig)).GetFuture().Share();
+    }
+    
+    StartProcessingThread();
+}
+
+void AFaceTracker::StartProcessingThread()
+{
+    if (ProcessingThread || !FrameSource || !FrameSource->IsStreaming() || !PendingModels.IsValid() || !PendingModels.IsReady())
+    {
+        return;
+    }
     
     // Get actual resolution
-    VideoWidth = VideoCapture.get(cv::CAP_PROP_FRAME_WIDTH);
-    VideoHeight = VideoCapture.get(cv::CAP_PROP_FRAME_HEIGHT);
+    VideoWidth = FrameSource->GetFrameSize().X;
+    VideoHeight = FrameSource->GetFrameSize().Y;
+    
+    UE_LOG(LogTemp, Log, TEXT("%s opened: %dx%d @ %.1f FPS"), *FrameSource->GetDescription(), VideoWidth, VideoHeight, FrameSource->GetFrameRate());
+    
+    // Create texture
+    VideoTexture = UTexture2D::CreateTransient(VideoWidth, VideoHeight, PF_B8G8R8A8);
+    if (VideoTexture)
+    {
+        VideoTexture->UpdateResource();
+        UE_LOG(LogTemp, Log, TEXT("Video texture created successfully"));
+    }
+    UpdateVideoMaterial();
+    
+    Models = PendingModels.Get();
+    PendingModels = TSharedFuture<FFaceTrackerModelsPtr>();
+    
+    // Start processing thread
+    ProcessingThread = new FVideoProcessingThread(FrameSource.Get(), Models.Get(), VideoWidth, VideoHeight, DetectionSettings, TargetFPS, bPipelineStages);
+    ProcessingThread->SetQuality(FFaceQualityController::GetLevel(QualityPolicy, QualityController.GetQuality()));
+    ProcessingThread->SetEmotionSmoothing(EmotionSmoothing);
+    ProcessingThread->SetFaceAssociation(FaceAssociation);
+    
+    if (EmotionLog.bRecord)
+    {
+        EmotionRecorder = MakeUnique<FFaceEmotionRecorder>();
+        const FString LogPath = FPaths::ProjectSavedDir() / TEXT("EmotionLogs") / FDateTime::Now().ToString() + TEXT(".femo");
+        if (EmotionRecorder->Open(LogPath, FIntPoint(VideoWidth, VideoHeight)))
+        {
+            ProcessingThread->SetEmotionRecorder(EmotionRecorder.Get());
+        }
+        else
+        {
+            EmotionRecorder.Reset();
+        }
+    }
+    
+    Thread = FRunnableThread::Create(ProcessingThread, TEXT("VideoProcessingThread"), 0, TPri_Normal);
+    
+    UE_LOG(LogTemp, Log, TEXT("Facial tracking initialized with threading and emotion detection"));
+    
+    // Only the first start after BeginPlay is a cold start, not a restart after the camera reconnects
+    if (BeginPlayTime > 0.0)
+    {
+        const float ColdStartMs = (float)((FPlatformTime::Seconds() - BeginPlayTime) * 1000.0);
+        BeginPlayTime = 0.0;
+        UE_LOG(LogTemp, Log, TEXT("Cold start took %.1f ms after BeginPlay"), ColdStartMs);
+        SET_FLOAT_STAT(STAT_FaceTracker_ColdStartMs, ColdStartMs);
+        CSV_CUSTOM_STAT(FaceTracker, ColdStartMs, ColdStartMs, ECsvCustomStatOp::Set);
+    }
+}
+
+void AFaceTracker::StopProcessingThread()
+{
+    // Stop thread, this also wakes a read waiting for the next camera frame
+    if (ProcessingThread)
+    {
+        ProcessingThread->Stop();
+    }
+    
+    if (Thread)
+    {
+        Thread->WaitForCompletion();
+        delete Thread;
+        Thread = nullptr;
+    }
+    
+    // Pending texture updates keep the upload pool alive themselves, no need to flush the render thread
+    if (ProcessingThread)
+    {
+        delete ProcessingThread;
+        ProcessingThread = nullptr;
+    }
+    
+    // After the worker, which appends to it
+    if (EmotionRecorder)
+    {
+        EmotionRecorder->Close();
+        EmotionRecorder.Reset();
+    }
+}
+
+void AFaceTracker::RestartProcessingThread()
+{
+    const FIntPoint FrameSize = FrameSource->GetFrameSize();
+    UE_LOG(LogTemp, Log, TEXT("%s reconnected at %dx%d instead of %dx%d, restarting face tracking"),
+        *FrameSource->GetDescription(), FrameSize.X, FrameSize.Y, VideoWidth, VideoHeight);
+    
+    // The models outlive the worker, hand them straight back to StartProcessingThread
+    StopProcessingThread();
+    PendingModels = MakeFulfilledPromise<FFaceTrackerModelsPtr>(MoveTemp(Models)).GetFuture().Share();
+    StartProcessingThread();
+}
+
+void AFaceTracker::SetOverlayVisible(bool bVisible)
+{
+    if (!OverlayWidget && bVisible && GetNetMode() != NM_DedicatedServer)
+    {
+        OverlayWidget = CreateWidget<UFaceTrackerOverlay>(GetWorld(), OverlayWidgetClass ? *OverlayWidgetClass : UFaceTrackerOverlay::StaticClass());
+        if (OverlayWidget)
+        {
+            OverlayWidget->Tracker = this;
+            OverlayWidget->AddToViewport();
+        }
+    }
+    
+    if (OverlayWidget)
+    {
+        OverlayWidget->SetVisibility(bVisible ? ESlateVisibility::HitTestInvisible : ESlateVisibility::Collapsed);
+    }
+}
+
+void AFaceTracker::UpdateVideoMaterial()
+{
+    if (!VideoMaterial)
+    {
+        return;
+    }
+    
+    if (!VideoMaterialInstance)
+    {
+        VideoMaterialInstance = UMaterialInstanceDynamic::Create(VideoMaterial, this);
+        
+        // The worker never flips the preview, a material that can't would show it unmirrored against the face boxes
+        float MirrorU = 0.0f;
+        if (!VideoMaterialInstance->GetScalarParameterValue(FHashedMaterialParameterInfo(TEXT("MirrorU")), MirrorU))
+        {
+            UE_LOG(LogTemp, Error, TEXT("%s has no MirrorU scalar parameter, the preview won't be mirrored. Run Content/Python/add_video_mirror_parameter.py on it"),
+                *VideoMaterial->GetPathName());
+        }
+        VideoMaterialInstance->SetScalarParameterValue(TEXT("MirrorU"), 1.0f);
+    }
+    
+    VideoMaterialInstance->SetTextureParameterValue(TEXT("VideoTexture"), VideoTexture);
+}
+
+// Called every frame
+void AFaceTracker::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+    
+    if (EmotionReplay)
+    {
+        TickEmotionReplay();
+        return;
+    }
+    
+    if (!ProcessingThread)
+    {
+        StartProcessingThread();
+    }
+    else if (ProcessingThread->HasFrameSizeChanged())
+    {
+        RestartProcessingThread();
+    }
+    
+    if (!ProcessingThread || !VideoTexture)
+    {
+        return;
+    }
+    
+    ProcessingThread->SetPreviewEnabled(bUploadPreview);
+    
+    // Back off the worker when the game thread or the pipeline run over budget
+    if (QualityController.Update(QualityPolicy, DeltaTime, FPlatformTime::ToMilliseconds(GGameThreadTime), ProcessingThread->GetPipelineLatencyMs()))
+    {
+        CurrentQuality = QualityController.GetQuality();
+        ProcessingThread->SetQuality(FFaceQualityController::GetLevel(QualityPolicy, CurrentQuality));
+    }
+    
+    TimeSinceLastUpdate += DeltaTime;
+    
+    // Limit texture update rate
+    float UpdateInterval = 1.0f / TargetFPS;
+    if (TimeSinceLastUpdate < UpdateInterval)
+    {
+        return;
+    }
+    
+    TimeSinceLastUpdate = 0.0f;
+    
+    // Hand the latest BGRA frame to the render thread, it goes back to the worker once uploaded
+    if (uint8* UploadBuffer = ProcessingThread->AcquireUploadBuffer())
+    {
+        UpdateTexture(UploadBuffer);
+    }
+    
+    DetectionStats = ProcessingThread->GetDetectionStats();
+    const FFaceSchedulerStats NewSchedulerStats = ProcessingThread->GetSchedulerStats();
+    const int32 FramesDropped = NewSchedulerStats.FramesDropped - SchedulerStats.FramesDropped;
+    SchedulerStats = NewSchedulerStats;
+    
+    // Get emotion data, nothing to do until the worker publishes a new frame
+    if (FFaceEmotionSnapshotPtr Snapshot = ProcessingThread->ConsumeEmotionSnapshot())
+    {
+        ApplyEmotionSnapshot(MoveTemp(Snapshot));
+    }
+    
+    // Counters for stat FaceTracker and CSV captures, taken from the worker's atomics on the game thread
+    const int32 NumFaces = GetDetectedEmotions().Num();
+    const float LatencyMs = ProcessingThread->GetPipelineLatencyMs();
+    SET_DWORD_STAT(STAT_FaceTracker_Faces, NumFaces);
+    SET_FLOAT_STAT(STAT_FaceTracker_LatencyMs, LatencyMs);
+    INC_DWORD_STAT_BY(STAT_FaceTracker_DroppedFrames, FramesDropped);
+    CSV_CUSTOM_STAT(FaceTracker, FacesPerFrame, NumFaces, ECsvCustomStatOp::Set);
+    CSV_CUSTOM_STAT(FaceTracker, PipelineLatencyMs, LatencyMs, ECsvCustomStatOp::Set);
+    CSV_CUSTOM_STAT(FaceTracker, DroppedFrames, FramesDropped, ECsvCustomStatOp::Accumulate);
+    
+    if (CVarFaceTrackerDebugHUD.GetValueOnGameThread())
+    {
+        DrawDebugHUD();
+    }
+}
+
+void AFaceTracker::DrawDebugHUD()
+{
+    if (!GEngine)
+    {
+        return;
+    }
+    
+    // Fixed keys per tracker, so each line is replaced rather than stacked
+    const uint64 Key = (uint64)GetUniqueID() << 4;
+    const FFaceFeatures Features = ProcessingThread->GetDebugFeatures();
+    const float DisplayTime = 1.0f / FMath::Max(TargetFPS, 1) + 0.1f;
+    
+    GEngine->AddOnScreenDebugMessage(Key, DisplayTime, FColor::White,
+        FString::Printf(TEXT("Faces %d  Latency %.1f ms  Quality %.2f"), GetDetectedEmotions().Num(), ProcessingThread->GetPipelineLatencyMs(), CurrentQuality));
+    GEngine->AddOnScreenDebugMessage(Key + 1, DisplayTime, FColor::White,
+        FString::Printf(TEXT("Frames %d  Late %d  Dropped %d  Last %.1f ms"), SchedulerStats.Frames, SchedulerStats.FramesLate, SchedulerStats.FramesDropped, SchedulerStats.LastFrameMs));
+    GEngine->AddOnScreenDebugMessage(Key + 2, DisplayTime, FColor::Cyan,
+        FString::Printf(TEXT("EyeAspectRatio: %f"), Features.EyeAspectRatio));
+    GEngine->AddOnScreenDebugMessage(Key + 3, DisplayTime, FColor::Blue,
+        FString::Printf(TEXT("RelativeEyeSize: %f"), Features.RelativeEyeSize));
+    GEngine->AddOnScreenDebugMessage(Key + 4, DisplayTime, FColor::Green,
+        FString::Printf(TEXT("SmileIntensity: %f"), Features.SmileIntensity));
+}
+
+void AFaceTracker::ApplyEmotionSnapshot(FFaceEmotionSnapshotPtr Snapshot)
+{
+    EmotionSnapshot = MoveTemp(Snapshot);
+    
+    // Trigger Blueprint event if emotion changed
+    const TArray<FFacialEmotionData>& DetectedEmotions = EmotionSnapshot->Emotions;
+    if (DetectedEmotions.Num() > 0)
+    {
+        EFacialEmotion CurrentEmotion = DetectedEmotions[0].Emotion;
+        if (CurrentEmotion != LastDetectedEmotion)
+        {
+            LastDetectedEmotion = CurrentEmotion;
+            OnEmotionDetected(CurrentEmotion, DetectedEmotions[0].Confidence);
+        }
+    }
+    
+    // Per-face channels, a face only counts as lost once the worker has retired its ID
+    for (const FFacialEmotionData& Face : DetectedEmotions)
+    {
+        FFaceChannel* Channel = FaceChannels.Find(Face.FaceId);
+        const bool bChanged = !Channel || Channel->Emotion != Face.Emotion;
+        FaceChannels.Add(Face.FaceId, { Face.Emotion, EmotionSnapshot->Sequence });
+        if (bChanged)
+        {
+            OnFaceEmotionChanged(Face.FaceId, Face.Emotion, Face.Confidence);
+        }
+    }
+    for (auto It = FaceChannels.CreateIterator(); It; ++It)
+    {
+        if (EmotionSnapshot->Sequence - It.Value().LastSequence > (uint64)FaceAssociation.MaxMissedFrames)
+        {
+            const int32 FaceId = It.Key();
+            It.RemoveCurrent();
+            OnFaceLost(FaceId);
+        }
+    }
+    
+}
+
+bool AFaceTracker::StartEmotionReplay()
+{
+    EmotionReplay = MakeUnique<FFaceEmotionLogReader>();
+    if (!EmotionReplay->Open(EmotionLog.ReplayPath) || EmotionReplay->Num() == 0)
+    {
+        EmotionReplay.Reset();
+        return false;
+    }
+    
+    VideoWidth = EmotionReplay->GetHeader().FrameWidth;
+    VideoHeight = EmotionReplay->GetHeader().FrameHeight;
+    ReplayIndex = 0;
+    ReplayStartTime = FPlatformTime::Seconds();
+    ReplaySequenceOffset = 0;
+    
+    UE_LOG(LogTemp, Log, TEXT("Replaying emotions from %s"), *EmotionLog.ReplayPath);
+    return true;
+}
+
+void AFaceTracker::TickEmotionReplay()
+{
+    const FFaceEmotionRecord* Records = EmotionReplay->GetRecords();
+    const int32 NumRecords = EmotionReplay->Num();
+    
+    if (ReplayIndex >= NumRecords)
+    {
+        if (!EmotionLog.bLoopReplay)
+        {
+            return;
+        }
+        ReplaySequenceOffset += Records[NumRecords - 1].Sequence + 1;
+        ReplayIndex = 0;
+        ReplayStartTime = FPlatformTime::Seconds();
+    }
+    
+    // Skip to the newest frame that is due, the live worker also only hands over its latest results
+    const double ReplayTime = FPlatformTime::Seconds() - ReplayStartTime;
+    int32 FrameStart = INDEX_NONE;
+    while (ReplayIndex < NumRecords && Records[ReplayIndex].Time <= ReplayTime)
+    {
+        FrameStart = ReplayIndex;
+        ReplayIndex = EmotionReplay->GetFrameEnd(ReplayIndex);
+    }
+    if (FrameStart == INDEX_NONE)
+    {
+        return;
+    }
+    
+    TSharedRef<FFaceEmotionSnapshot, ESPMode::ThreadSafe> Snapshot = MakeShared<FFaceEmotionSnapshot, ESPMode::ThreadSafe>();
+    Snapshot->Sequence = ReplaySequenceOffset + Records[FrameStart].Sequence;
+    for (int32 RecordIndex = FrameStart; RecordIndex < ReplayIndex; RecordIndex++)
+    {
+        const FFaceEmotionRecord& Record = Records[RecordIndex];
+        if (Record.FaceId == 0)
+        {
+            continue;
+        }
+        
+        FFacialEmotionData& EmotionData = Snapshot->Emotions.AddDefaulted_GetRef();
+        EmotionData.FaceId = Record.FaceId;
+        EmotionData.Emotion = (EFacialEmotion)Record.Emotion;
+        EmotionData.Confidence = Record.Probabilities[FMath::Min<int32>(Record.Emotion, FDnnEmotionClassifier::NumEmotions - 1)];
+        EmotionData.RawEmotion = (EFacialEmotion)Record.RawEmotion;
+        EmotionData.FaceCenter = FVector2D(Record.FaceX + Record.FaceWidth / 2.0f, Record.FaceY + Record.FaceHeight / 2.0f);
+        EmotionData.FaceSize = Record.FaceWidth;
+        EmotionData.FaceBox = FBox2D(FVector2D(Record.FaceX, Record.FaceY), FVector2D(Record.FaceX + Record.FaceWidth, Record.FaceY + Record.FaceHeight));
+        EmotionData.Probabilities.Append(Record.Probabilities, FDnnEmotionClassifier::NumEmotions);
+    }
+    
+    ApplyEmotionSnapshot(Snapshot);
+}
+
+bool AFaceTracker::GetFaceEmotion(int32 FaceId, FFacialEmotionData& OutData) const
+{
+    for (const FFacialEmotionData& Face : GetDetectedEmotions())
+    {
+        if (Face.FaceId == FaceId)
+        {
+            OutData = Face;
+            return true;
+        }
+    }
+    return false;
+}
+
+const TArray<FFacialEmotionData>& AFaceTracker::GetDetectedEmotions() const
+{
+    static const TArray<FFacialEmotionData> NoEmotions;
+    return EmotionSnapshot ? EmotionSnapshot->Emotions : NoEmotions;
+}
+
+void AFaceTracker::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    Super::EndPlay(EndPlayReason);
+        
+    UE_LOG(LogTemp, Log, TEXT("Shutting down Facial Expression Tracker..."));
+    
+    if (OverlayWidget)
+    {
+        OverlayWidget->RemoveFromParent();
+        OverlayWidget = nullptr;
+    }
+    
+    StopProcessingThread();
+    
+    // Back to the cache for the next tracker, e.g. after a level transition. A load still in flight is dropped when it finishes
+    UGameInstance* GameInstance = GetGameInstance();
+    UFaceModelSubsystem* ModelSubsystem = GameInstance ? GameInstance->GetSubsystem<UFaceModelSubsystem>() : nullptr;
+    if (Models && ModelSubsystem)
+    {
+        ModelSubsystem->ReleaseModels(ModelConfig, MoveTemp(Models));
+    }
+    Models.Reset();
+    PendingModels = TSharedFuture<FFaceTrackerModelsPtr>();
+    EmotionReplay.Reset();
+    
+    UFaceCameraSubsystem* CameraSubsystem = GameInstance ? GameInstance->GetSubsystem<UFaceCameraSubsystem>() : nullptr;
+    if (CameraSubsystem && CameraStateHandle.IsValid())
+    {
+        CameraSubsystem->OnCameraStateChanged.Remove(CameraStateHandle);
+    }
+    CameraStateHandle.Reset();
+    
+    // Release frame source, a shared webcam only closes once nothing has used it for a while
+    if (FrameSource)
+    {
+        FrameSource->Close();
+        FrameSource.Reset();
+        UE_LOG(LogTemp, Log, TEXT("Frame source released"));
+    }
+    
+    UE_LOG(LogTemp, Log, TEXT("Facial Expression Tracker shutdown complete"));
+    
+}
+
+EFaceCameraState AFaceTracker::GetCameraState() const
+{
+    if (!FrameSource)
+    {
+        return EFaceCameraState::Closed;
+    }
+    if (CaptureSettings.SourceType != EFaceFrameSourceType::Camera || !CameraStateHandle.IsValid())
+    {
+        return FrameSource->IsStreaming() ? EFaceCameraState::Streaming : EFaceCameraState::Closed;
+    }
+    
+    const UGameInstance* GameInstance = GetGameInstance();
+    const UFaceCameraSubsystem* CameraSubsystem = GameInstance ? GameInstance->GetSubsystem<UFaceCameraSubsystem>() : nullptr;
+    return CameraSubsystem ? CameraSubsystem->GetCameraState(CaptureSettings.CameraIndex) : EFaceCameraState::Closed;
+}
+
+void AFaceTracker::HandleCameraStateChanged(int32 CameraIndex, EFaceCameraState State)
+{
+    if (CameraIndex == CaptureSettings.CameraIndex)
+    {
+        OnCameraStateChanged(State);
+    }
+}
+
+FFaceModelConfig AFaceTracker::GetModelConfig() const
+{
+    FFaceModelConfig Config;
+    Config.Detector = GetDetectorConfig();
+    Config.Classifier = EmotionClassifier;
+    Config.EyeCascadePath = EyeCascadePath;
+    Config.SmileCascadePath = SmileCascadePath;
+    Config.NumFeatureSlots = MaxParallelFaces;
+    return Config;
+}
+
+FString FFaceModelConfig::GetKey() const
+{
+    return FString::Printf(TEXT("%d|%s|%s|%s|%g|%d|%d|%s|%s|%d|%g|%d|%s|%d|%s|%s|%d"),
+        (int32)Detector.Backend, *Detector.HaarCascadePath, *Detector.DnnModelPath, *Detector.DnnConfigPath, Detector.DnnConfidenceThreshold, Detector.DnnInputSize,
+        (int32)Classifier.Backend, *Classifier.ModelPath, *Classifier.Labels, Classifier.InputSize, Classifier.InputScale, (int32)Classifier.bApplySoftmax,
+        *Classifier.LandmarkModelPath, Classifier.LandmarkInputSize,
+        *EyeCascadePath, *SmileCascadePath, NumFeatureSlots);
+}
+
+FFaceDetectorConfig AFaceTracker::GetDetectorConfig() const
+{
+    FFaceDetectorConfig Config;
+    Config.Backend = DetectionSettings.Backend;
+    Config.HaarCascadePath = HaarCascadePath;
+    Config.DnnModelPath = DnnFaceModelPath;
+    Config.DnnConfigPath = DnnFaceConfigPath;
+    Config.DnnConfidenceThreshold = DetectionSettings.DnnConfidenceThreshold;
+    Config.DnnInputSize = DetectionSettings.DnnInputSize;
+    return Config;
+}
+
+void AFaceTracker::UpdateTexture(uint8* UploadBuffer)
+{
+    FFaceUploadBufferPoolRef Pool = ProcessingThread->GetUploadPool();
     
-    UE_LOG(LogTemp, Log, TEXT("Webcam opened: %dx%d @ %d FPS"), VideoWidth, VideoHeight, TargetFPS);
+    if (!VideoTexture || !VideoTexture->GetResource())
+    {
+        Pool->FreeBuffers.Enqueue(UploadBuffer);
+        return;
+    }
     
-    // Load Haar Cascades
-    std::string FaceCascadePathStr(TCHAR_TO_UTF8(*HaarCascadePath));
+    // The render thread reads the buffer directly and returns it to the pool when done. The pool stays alive
+    // until then even if the worker is replaced in the meantime
+    VideoTexture->UpdateTextureRegions(
+        0,
+        1,
+        &Pool->Region,
+        VideoWidth * 4,
+        4,
+        UploadBuffer,
+        [Pool](uint8* SrcData, const FUpdateTextureRegion2D* Regions)
+        {
+            Pool->FreeBuffers.Enqueue(SrcData);
+        }
+    );
+}
+
+FFaceUploadBufferPool::FFaceUploadBufferPool(int32 Width, int32 Height, int32 NumBuffers)
+: Region(0, 0, 0, 0, Width, Height)
+{
+    // Allocated once, buffers are only ever recycled after this
+    Buffers.SetNum(NumBuffers);
+    for (TArray<uint8>& Buffer : Buffers)
+    {
+        Buffer.SetNumUninitialized(Width * Height * 4);
+        FreeBuffers.Enqueue(Buffer.GetData());
+    }
+}
+
+bool FFaceTrackerModels::Load(const FFaceDetectorConfig& DetectorConfig, const FEmotionClassifierSettings& ClassifierSettings,
+    const FString& EyeCascadePath, const FString& SmileCascadePath, int32 NumFeatureSlots)
+{
     std::string EyeCascadePathStr(TCHAR_TO_UTF8(*EyeCascadePath));
     std::string SmileCascadePathStr(TCHAR_TO_UTF8(*SmileCascadePath));
     
-    if (!FaceCascade.load(FaceCascadePathStr))
+    FaceDetector = IFaceDetector::Create(DetectorConfig);
+    bool bLoaded = FaceDetector->Load();
+    
+    // The CNN and the landmark fit replace the eye and smile cascades entirely
+    EmotionClassifier.Reset();
+    Landmarker.Reset();
+    FeatureCascades.clear();
+    if (ClassifierSettings.Backend == EEmotionClassifierBackend::DnnFer)
     {
-        UE_LOG(LogTemp, Error, TEXT("Failed to load Face Cascade from: %s"), *HaarCascadePath);
+        EmotionClassifier = MakeUnique<FDnnEmotionClassifier>(ClassifierSettings);
+        return EmotionClassifier->Load() && bLoaded;
     }
-    else
+    if (ClassifierSettings.Backend == EEmotionClassifierBackend::Landmarks)
+    {
+        Landmarker = MakeUnique<FDnnFaceLandmarker>(ClassifierSettings.LandmarkModelPath, ClassifierSettings.LandmarkInputSize);
+        return Landmarker->Load() && bLoaded;
+    }
+    
+    FeatureCascades.resize(FMath::Max(NumFeatureSlots, 1));
+    for (FFaceFeatureCascades& Cascades : FeatureCascades)
+    {
+        if (!Cascades.EyeCascade.load(EyeCascadePathStr))
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to load Eye Cascade from: %s"), *EyeCascadePath);
+            bLoaded = false;
+        }
+        
+        if (!Cascades.SmileCascade.load(SmileCascadePathStr))
+        {
+            UE_LOG(LogTemp, Error, TEXT("Failed to load Smile Cascade from: %s"), *SmileCascadePath);
+            bLoaded = false;
+        }
+    }
+    
+    if (bLoaded)
+    {
+        UE_LOG(LogTemp, Log, TEXT("Eye and Smile Cascades loaded successfully (%d slots)"), (int32)FeatureCascades.size());
+    }
+    
+    return bLoaded;
+}
+
+// Runs one pipeline stage on its own thread, moving packets from its input queue to its output queue
+class FFaceStageWorker : public FRunnable
+{
+public:
+	FFaceStageWorker(TFunction<void(FFaceFramePacket&)> InProcess, FFacePacketQueue& InInput, FFacePacketQueue& InOutput)
+	: Process(MoveTemp(InProcess))
+	, Input(InInput)
+	, Output(InOutput)
+	, bRunning(true)
+	{
+	}
+
+	virtual uint32 Run() override
+	{
+	    while (bRunning)
+	    {
+	        FFaceFramePacket* Packet = nullptr;
+	        if (!Input.Pop(Packet))
+	        {
+	            Input.WaitForData(10);
+	            continue;
+	        }
+	        
+	        Process(*Packet);
+	        
+	        // Hold the packet until the next stage has room for it
+	        while (!Output.Push(Packet))
+	        {
+	            if (!bRunning)
+	            {
+	                return 0;
+	            }
+	            Output.WaitForSpace(10);
+	        }
+	    }
+	    
+	    return 0;
+	}
+
+	virtual void Stop() override
+	{
+	    bRunning = false;
+	}
+
+private:
+	TFunction<void(FFaceFramePacket&)> Process;
+	FFacePacketQueue& Input;
+	FFacePacketQueue& Output;
+	FThreadSafeBool bRunning;
+};
+
+FVideoProcessingThread::FVideoProcessingThread(IFaceFrameSource* InFrameSource, FFaceTrackerModels* InModels,
+	int32 InFrameWidth, int32 InFrameHeight, const FFaceDetectionSettings& InDetectionSettings, float InTargetFrameRate, bool bInPipelineStages)
+: FrameSource(InFrameSource)
+, Models(InModels)
+, FrameWidth(InFrameWidth)
+, FrameHeight(InFrameHeight)
+, UploadPool(MakeShared<FFaceUploadBufferPool, ESPMode::ThreadSafe>(InFrameWidth, InFrameHeight, NumUploadBuffers))
+, DetectionSettings(InDetectionSettings)
+, TargetFrameRate(InTargetFrameRate)
+, bRunning(true)
+, Scheduler(InTargetFrameRate)
+, bPipelineStages(bInPipelineStages)
+, PreprocessQueue(1)
+, DetectQueue(1)
+, ClassifyQueue(1)
+, AnnotateQueue(1)
+, FreePackets(NumPipelinePackets)
+{
+    // Packets circulate through the stage queues and come back to the capture stage once annotated
+    if (bPipelineStages)
+    {
+        for (int32 PacketIndex = 0; PacketIndex < NumPipelinePackets; PacketIndex++)
+        {
+            PacketPool.Add(MakeUnique<FFaceFramePacket>());
+            FreePackets.Push(PacketPool.Last().Get());
+        }
+    }
+}
+
+FVideoProcessingThread::~FVideoProcessingThread()
+{
+	Stop();
+	StopStageWorkers();
+}
+
+bool FVideoProcessingThread::Init()
+{
+	UE_LOG(LogTemp, Log, TEXT("Video processing thread initialized"));
+	return true;
+}
+
+uint32 FVideoProcessingThread::Run()
+{
+	if (bPipelineStages)
+	{
+	    StartStageWorkers();
+	}
+	
+	Scheduler.Reset();
+	
+	while (bRunning)
+	{
+		if (!FrameSource || !FrameSource->IsOpen())
+		{
+		    FPlatformProcess::Sleep(0.033f);
+		    Scheduler.Reset();
+		    continue;
+		}
+		
+		Scheduler.SetTargetFrameRate(TargetFrameRate * GetQuality().FrameRateScale);
+		
+		if (bPipelineStages)
+		{
+		    // Retry until the slowest stage frees up, the wait counts against this frame's deadline
+		    if (!CaptureIntoPipeline())
+		    {
+		        continue;
+		    }
+		}
+		else if (!ProcessFrame())
+		{
+		    // Nothing was captured, so there is no frame to count against the schedule
+		    Scheduler.WaitAfterFailedRead();
+		    continue;
+		}
+		
+		TRACE_CPUPROFILER_EVENT_SCOPE(FaceTracker_WaitForNextFrame);
+		Scheduler.WaitForNextFrame(*FrameSource);
+	}
+	
+	StopStageWorkers();
+    
+	return 0;
+}
+
+void FVideoProcessingThread::Stop()
+{
+    bRunning = false;
+    
+    // Don't wait out the read timeout, e.g. while the camera is reconnecting
+    if (FrameSource)
+    {
+        FrameSource->CancelRead();
+    }
+}
+
+void FVideoProcessingThread::Exit()
+{
+    UE_LOG(LogTemp, Log, TEXT("Video processing thread exiting"));
+}
+
+uint8* FVideoProcessingThread::AcquireUploadBuffer()
+{
+    uint8** Slot = UploadHandoff.ConsumeLatest();
+    if (!Slot)
     {
-        UE_LOG(LogTemp, Log, TEXT("Face Cascade loaded successfully"));
+        return nullptr;
     }
     
-    if (!EyeCascade.load(EyeCascadePathStr))
+    // Clear the slot so the worker knows this buffer has been taken
+    uint8* Buffer = *Slot;
+    *Slot = nullptr;
+    return Buffer;
+}
+
+void FVideoProcessingThread::ReleaseUploadBuffer(uint8* Buffer)
+{
+    if (Buffer)
+    {
+        UploadPool->FreeBuffers.Enqueue(Buffer);
+    }
+}
+
+FFaceFeatures FVideoProcessingThread::GetDebugFeatures()
+{
+    FScopeLock Lock(&EmotionMutex);
+    return DebugFeatures;
+}
+
+FFaceEmotionSnapshotPtr FVideoProcessingThread::ConsumeEmotionSnapshot()
+{
+    FFaceEmotionSnapshotPtr* Latest = EmotionHandoff.ConsumeLatest();
+    return Latest ? *Latest : nullptr;
+}
+
+void FVideoProcessingThread::SetTimings(FFacePipelineTimings* InTimings)
+{
+    Timings = InTimings;
+}
+
+bool FVideoProcessingThread::ProcessFrame()
+{
+    TRACE_CPUPROFILER_EVENT_SCOPE(FaceTracker_Frame);
+    SCOPE_CYCLE_COUNTER(STAT_FaceTracker_Frame);
+    const uint64 FrameStartCycles = FPlatformTime::Cycles64();
+    if (Timings)
+    {
+        Timings->BeginFrame();
+    }
+    
+    if (!CaptureStage(SyncPacket))
+    {
+        return false;
+    }
+    
+    PreprocessStage(SyncPacket);
+    if (SyncPacket.bDropped)
+    {
+        return false;
+    }
+    DetectStage(SyncPacket);
+    ClassifyStage(SyncPacket);
+    AnnotateStage(SyncPacket);
+    
+    if (Timings)
+    {
+        Timings->AddCycles(EFacePipelineStage::Frame, FPlatformTime::Cycles64() - FrameStartCycles);
+        Timings->EndFrame();
+    }
+    
+    return true;
+}
+
+void FVideoProcessingThread::StartStageWorkers()
+{
+    auto AddStageWorker = [this](const TCHAR* ThreadName, TFunction<void(FFaceFramePacket&)> Process, FFacePacketQueue& Input, FFacePacketQueue& Output)
+    {
+        FFaceStageWorker* Worker = StageWorkers.Add_GetRef(MakeUnique<FFaceStageWorker>(MoveTemp(Process), Input, Output)).Get();
+        StageThreads.Add(FRunnableThread::Create(Worker, ThreadName, 0, TPri_Normal));
+    };
+    
+    AddStageWorker(TEXT("FacePreprocessThread"), [this](FFaceFramePacket& Packet) { PreprocessStage(Packet); }, PreprocessQueue, DetectQueue);
+    AddStageWorker(TEXT("FaceDetectThread"), [this](FFaceFramePacket& Packet) { DetectStage(Packet); }, DetectQueue, ClassifyQueue);
+    AddStageWorker(TEXT("FaceClassifyThread"), [this](FFaceFramePacket& Packet) { ClassifyStage(Packet); }, ClassifyQueue, AnnotateQueue);
+    AddStageWorker(TEXT("FaceAnnotateThread"), [this](FFaceFramePacket& Packet) { AnnotateStage(Packet); }, AnnotateQueue, FreePackets);
+}
+
+void FVideoProcessingThread::StopStageWorkers()
+{
+    for (TUniquePtr<FFaceStageWorker>& Worker : StageWorkers)
+    {
+        Worker->Stop();
+    }
+    
+    for (FRunnableThread* StageThread : StageThreads)
+    {
+        if (StageThread)
+        {
+            StageThread->WaitForCompletion();
+            delete StageThread;
+        }
+    }
+    
+    StageThreads.Reset();
+    StageWorkers.Reset();
+}
+
+bool FVideoProcessingThread::CaptureIntoPipeline()
+{
+    // Only capture once preprocessing can take the frame, so a slow stage never queues up stale frames
+    if (!PreprocessQueue.HasSpace())
+    {
+        PreprocessQueue.WaitForSpace(10);
+        return false;
+    }
+    
+    if (!CapturePacket && !FreePackets.Pop(CapturePacket))
+    {
+        FreePackets.WaitForData(10);
+        return false;
+    }
+    
+    // Keep the packet for the next attempt if the read failed. Recorded sources stay open at the end of a clip
+    // that doesn't loop, so back off rather than retrying straight away
+    if (!CaptureStage(*CapturePacket))
+    {
+        Scheduler.WaitAfterFailedRead();
+        return false;
+    }
+    
+    PreprocessQueue.Push(CapturePacket);
+    CapturePacket = nullptr;
+    return true;
+}
+
+bool FVideoProcessingThread::CaptureStage(FFaceFramePacket& Packet)
+{
+    Packet.Quality = GetQuality();
+    
+    // Capture frame, reusing the packet's allocation
+    FACE_PIPELINE_SCOPE(Timings, Capture);
+    Packet.CaptureTime = FPlatformTime::Seconds();
+    if (!FrameSource->ReadFrame(Packet.Frame) || Packet.Frame.empty())
+    {
+        return false;
+    }
+    
+    // A webcam can come back from a reconnect at another size, nothing downstream is sized for it
+    if (FrameSource->GetFrameSize() != FIntPoint(FrameWidth, FrameHeight))
+    {
+        bFrameSizeChanged.store(true, std::memory_order_relaxed);
+        return false;
+    }
+    
+    Packet.FrameFormat = FrameSource->GetFrameFormat();
+    Packet.bDropped = false;
+    return true;
+}
+
+// Largest libjpeg DCT-domain reduction, 1/2, 1/4 or 1/8, that keeps at least the detection resolution
+static int32 GetJpegReduction(float DetectionScale)
+{
+    int32 Reduction = 1;
+    while (Reduction < 8 && 1.0f / (Reduction * 2) >= DetectionScale - KINDA_SMALL_NUMBER)
+    {
+        Reduction *= 2;
+    }
+    return Reduction;
+}
+
+static int32 GetJpegGrayscaleFlag(int32 Reduction)
+{
+    switch (Reduction)
+    {
+        case 2:
+            return cv::IMREAD_REDUCED_GRAYSCALE_2;
+        case 4:
+            return cv::IMREAD_REDUCED_GRAYSCALE_4;
+        case 8:
+            return cv::IMREAD_REDUCED_GRAYSCALE_8;
+        default:
+            return cv::IMREAD_GRAYSCALE;
+    }
+}
+
+void FVideoProcessingThread::PreprocessStage(FFaceFramePacket& Packet)
+{
+    // Only luma is needed from here on. The captured frame is left as it is until the annotation stage,
+    // which converts it to colour only if the frame is previewed. Only the luma frame is flipped for the
+    // mirror effect, the preview material mirrors the video
+    Packet.GrayScale = 1.0f;
+    
+    // Reference path for the mirror test and the benchmark, flips the whole captured frame the way the tracker
+    // used to. A copy, as the frame may be shared with other subscribers. MJPEG can only be flipped once decoded
+    const bool bMirrorLuma = !bReferenceMirror || Packet.FrameFormat == EFaceFrameFormat::Mjpeg;
+    if (!bMirrorLuma)
+    {
+        cv::Mat Flipped;
+        cv::flip(Packet.Frame, Flipped, 1);
+        Packet.Frame = Flipped;
+    }
+    
+    switch (Packet.FrameFormat)
+    {
+        case EFaceFrameFormat::Grey:
+            // Already luma, flipped into the packet's own buffer or shared with the captured frame
+            if (bMirrorLuma)
+            {
+                FACE_PIPELINE_SCOPE(Timings, Mirror);
+                cv::flip(Packet.Frame, Packet.GrayFrame, 1);
+            }
+            else
+            {
+                Packet.GrayFrame = Packet.Frame;
+            }
+            break;
+        case EFaceFrameFormat::Mjpeg:
+        {
+            // libjpeg scales in the DCT domain and skips chroma, so the decode lands close to detection resolution
+            FACE_PIPELINE_SCOPE(Timings, Decode);
+            cv::imdecode(Packet.Frame, GetJpegGrayscaleFlag(GetJpegReduction(Packet.Quality.DetectionScale)), &Packet.GrayFrame);
+            if (Packet.GrayFrame.empty())
+            {
+                // Truncated and corrupt MJPEG frames are routine on USB webcams, drop it like a failed read
+                Packet.bDropped = true;
+                return;
+            }
+            Packet.GrayScale = (float)Packet.GrayFrame.cols / FrameWidth;
+            break;
+        }
+        case EFaceFrameFormat::Yuyv:
+        {
+            // Every other byte is luma
+            FACE_PIPELINE_SCOPE(Timings, GrayConvert);
+            cv::extractChannel(Packet.Frame, Packet.GrayFrame, 0);
+            break;
+        }
+        default:
+        {
+            FACE_PIPELINE_SCOPE(Timings, GrayConvert);
+            cv::cvtColor(Packet.Frame, Packet.GrayFrame, cv::COLOR_BGR2GRAY);
+            break;
+        }
+    }
+    
+    // Gray conversion and channel extraction work per pixel, so flipping their single channel result gives
+    // exactly the pixels of a flipped capture. Flipping after the resize would be cheaper still but isn't
+    // exact, cv::resize rounds differently on the mirrored side at most scales
+    if (bMirrorLuma && Packet.FrameFormat != EFaceFrameFormat::Grey)
+    {
+        FACE_PIPELINE_SCOPE(Timings, Mirror);
+        cv::flip(Packet.GrayFrame, Packet.GrayFrame, 1);
+    }
+    
+    // Resize for faster processing, the rest of the way if the decoder already scaled down
+    const float ResizeScale = Packet.Quality.DetectionScale / Packet.GrayScale;
+    const bool bResize = !FMath::IsNearlyEqual(ResizeScale, 1.0f);
+    if (bResize)
+    {
+        FACE_PIPELINE_SCOPE(Timings, Resize);
+        cv::resize(Packet.GrayFrame, Packet.SmallFrame, cv::Size(), ResizeScale, ResizeScale);
+    }
+    {
+        FACE_PIPELINE_SCOPE(Timings, Equalize);
+        cv::equalizeHist(bResize ? Packet.SmallFrame : Packet.GrayFrame, Packet.SmallFrame);
+    }
+}
+
+void FVideoProcessingThread::DetectStage(FFaceFramePacket& Packet)
+{
+    if (Packet.bDropped)
+    {
+        return;
+    }
+    
+    // Detect or track faces
+    std::vector<cv::Rect> Faces;
+    UpdateFaces(Packet.SmallFrame, Packet.Quality, Faces);
+    
+    Packet.ScaledFaces.clear();
+    
+    const float InverseScale = 1.0f / Packet.Quality.DetectionScale;
+    for (size_t i = 0; i < Faces.size(); i++)
+    {
+        // Scale back to original size
+        cv::Rect ScaledFace(FMath::RoundToInt(Faces[i].x * InverseScale), FMath::RoundToInt(Faces[i].y * InverseScale), 
+                           FMath::RoundToInt(Faces[i].width * InverseScale), FMath::RoundToInt(Faces[i].height * InverseScale));
+        
+        // Ensure face rect is within image bounds
+        ScaledFace.x = FMath::Max(0, ScaledFace.x);
+        ScaledFace.y = FMath::Max(0, ScaledFace.y);
+        ScaledFace.width = FMath::Min(ScaledFace.width, FrameWidth - ScaledFace.x);
+        ScaledFace.height = FMath::Min(ScaledFace.height, FrameHeight - ScaledFace.y);
+        
+        // Detection ran on the mirrored frame, so the published rects already are mirrored
+        if (ScaledFace.width > 0 && ScaledFace.height > 0)
+        {
+            Packet.ScaledFaces.push_back(ScaledFace);
+        }
+    }
+    
+    // Give every face its persistent ID, in order so the classifier and smoother see the same face at the same index
+    {
+        FACE_PIPELINE_SCOPE(Timings, AssociateFaces);
+        FaceAssociator.Update(Packet.ScaledFaces, Packet.FaceIds);
+    }
+    
+    // Classifiers crop the mirrored gray frame, which is smaller than the full frame after a reduced MJPEG decode
+    const cv::Rect GrayBounds(0, 0, Packet.GrayFrame.cols, Packet.GrayFrame.rows);
+    Packet.GrayFaces.clear();
+    for (const cv::Rect& Face : Packet.ScaledFaces)
+    {
+        if (Packet.GrayScale == 1.0f)
+        {
+            Packet.GrayFaces.push_back(Face);
+            continue;
+        }
+        
+        const cv::Rect GrayFace(FMath::RoundToInt(Face.x * Packet.GrayScale), FMath::RoundToInt(Face.y * Packet.GrayScale),
+                                FMath::Max(1, FMath::RoundToInt(Face.width * Packet.GrayScale)), FMath::Max(1, FMath::RoundToInt(Face.height * Packet.GrayScale)));
+        Packet.GrayFaces.push_back(GrayFace & GrayBounds);
+    }
+}
+
+void FVideoProcessingThread::ClassifyStage(FFaceFramePacket& Packet)
+{
+    if (Packet.bDropped)
     {
-        UE_LOG(LogTemp, Error, TEXT("Failed to load Eye Cascade from: %s"), *EyeCascadePath);
+        return;
     }
-    else
+    
+    const int32 NumFaces = Packet.ScaledFaces.size();
+    
+    // At reduced quality the classifier only runs every few frames, in between faces keep their last result
+    if (++FramesSinceFeatures < Packet.Quality.FeatureInterval && NumFaces > 0 && Packet.FaceIds == LastFaceIds)
     {
-        UE_LOG(LogTemp, Log, TEXT("Eye Cascade loaded successfully"));
+        Packet.Emotions = LastEmotions;
+        Packet.Confidences = LastConfidences;
+        Packet.Features = LastFeatures;
+        Packet.Probabilities = LastProbabilities;
+        return;
     }
+    FramesSinceFeatures = 0;
+    
+    Packet.Emotions.SetNum(NumFaces);
+    Packet.Confidences.SetNum(NumFaces);
+    Packet.Features.SetNum(NumFaces);
     
-    if (!SmileCascade.load(SmileCascadePathStr))
+    if (Models->EmotionClassifier)
     {
-        UE_LOG(LogTemp, Error, TEXT("Failed to load Smile Cascade from: %s"), *SmileCascadePath);
+        ClassifyBatch(Packet);
     }
-    else
+    else if (Models->Landmarker)
     {
-        UE_LOG(LogTemp, Log, TEXT("Smile Cascade loaded successfully"));
+        ClassifyFromLandmarks(Packet);
     }
-    
-    // Create texture
-    VideoTexture = UTexture2D::CreateTransient(VideoWidth, VideoHeight, PF_B8G8R8A8);
-    if (VideoTexture)
+    else
     {
-        VideoTexture->UpdateResource();
-        UE_LOG(LogTemp, Log, TEXT("Video texture created successfully"));
+        ClassifyFromFeatures(Packet);
     }
     
-    // Create update region
-    VideoUpdateTextureRegion = new FUpdateTextureRegion2D(0, 0, 0, 0, VideoWidth, VideoHeight);
-    
-    // Initialize buffer
-    VideoBuffer.SetNum(VideoWidth * VideoHeight * 4);
-    
-    // Start processing thread
-    ProcessingThread = new FVideoProcessingThread(&VideoCapture, &FaceCascade, &EyeCascade, &SmileCascade);
-    Thread = FRunnableThread::Create(ProcessingThread, TEXT("VideoProcessingThread"), 0, TPri_Normal);
-    
-    UE_LOG(LogTemp, Log, TEXT("Facial tracking initialized with threading and emotion detection"));
-    
+    LastFaceIds = Packet.FaceIds;
+    LastEmotions = Packet.Emotions;
+    LastConfidences = Packet.Confidences;
+    LastFeatures = Packet.Features;
+    LastProbabilities = Packet.Probabilities;
 }
 
-// Called every frame
-void AFaceTracker::Tick(float DeltaTime)
+void FVideoProcessingThread::ClassifyBatch(FFaceFramePacket& Packet)
 {
-	Super::Tick(DeltaTime);
+    FACE_PIPELINE_SCOPE(Timings, Classify);
     
-    if (!ProcessingThread || !VideoTexture)
+    // All faces in one forward pass
+    Models->EmotionClassifier->Classify(Packet.GrayFrame, Packet.GrayFaces, Packet.Probabilities);
+    
+    const int32 NumFaces = Packet.ScaledFaces.size();
+    for (int32 FaceIndex = 0; FaceIndex < NumFaces; FaceIndex++)
     {
-        return;
+        const float* Probabilities = Packet.Probabilities.GetData() + FaceIndex * FDnnEmotionClassifier::NumEmotions;
+        
+        int32 BestEmotion = 0;
+        for (int32 Emotion = 1; Emotion < FDnnEmotionClassifier::NumEmotions; Emotion++)
+        {
+            if (Probabilities[Emotion] > Probabilities[BestEmotion])
+            {
+                BestEmotion = Emotion;
+            }
+        }
+        
+        Packet.Emotions[FaceIndex] = (EFacialEmotion)BestEmotion;
+        Packet.Confidences[FaceIndex] = Probabilities[BestEmotion];
+        Packet.Features[FaceIndex] = FFaceFeatures();
     }
+}
+
+void FVideoProcessingThread::ClassifyFromFeatures(FFaceFramePacket& Packet)
+{
+    // Classify faces in parallel. Each slot owns a set of cascades and takes every NumSlots-th face
+    const int32 NumFaces = Packet.ScaledFaces.size();
+    const int32 NumSlots = FMath::Min(NumFaces, (int32)Models->FeatureCascades.size());
     
-    TimeSinceLastUpdate += DeltaTime;
+    ParallelFor(NumSlots, [this, &Packet, NumFaces, NumSlots](int32 Slot)
+    {
+        FFaceFeatureCascades& Cascades = Models->FeatureCascades[Slot];
+        for (int32 FaceIndex = Slot; FaceIndex < NumFaces; FaceIndex += NumSlots)
+        {
+            // Get face region from original grayscale
+            const cv::Rect& GrayFace = Packet.GrayFaces[FaceIndex];
+            Packet.Emotions[FaceIndex] = DetectEmotion(Packet.GrayFrame(GrayFace), GrayFace, Packet.GrayScale, Cascades, Packet.Features[FaceIndex], Packet.Confidences[FaceIndex]);
+        }
+    }, NumSlots > 1 ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
     
-    // Limit texture update rate
-    float UpdateInterval = 1.0f / TargetFPS;
-    if (TimeSinceLastUpdate < UpdateInterval)
+    SpreadConfidence(Packet);
+}
+
+void FVideoProcessingThread::ClassifyFromLandmarks(FFaceFramePacket& Packet)
+{
+    // One regressor pass for all faces instead of two cascades per face
     {
-        return;
+        FACE_PIPELINE_SCOPE(Timings, FitLandmarks);
+        Models->Landmarker->Fit(Packet.GrayFrame, Packet.GrayFaces, Packet.Landmarks);
     }
     
-    TimeSinceLastUpdate = 0.0f;
-    
-    // Get processed frame from worker thread
-    cv::Mat ProcessedFrame;
-    if (ProcessingThread->GetProcessedFrame(ProcessedFrame))
+    FACE_PIPELINE_SCOPE(Timings, Classify);
+    const int32 NumFaces = Packet.ScaledFaces.size();
+    for (int32 FaceIndex = 0; FaceIndex < NumFaces; FaceIndex++)
     {
-        UpdateTexture(ProcessedFrame);
+        Packet.Emotions[FaceIndex] = DetectEmotionFromLandmarks(Packet.Landmarks.GetData() + FaceIndex * FDnnFaceLandmarker::NumLandmarks,
+            Packet.GrayFaces[FaceIndex], Packet.Features[FaceIndex], Packet.Confidences[FaceIndex]);
     }
     
-    // Get emotion data
-    DetectedEmotions = ProcessingThread->GetEmotionData();
-    
-    // Trigger Blueprint event if emotion changed
-    if (DetectedEmotions.Num() > 0)
+    SpreadConfidence(Packet);
+}
+
+void FVideoProcessingThread::SpreadConfidence(FFaceFramePacket& Packet)
+{
+    const int32 NumFaces = Packet.ScaledFaces.size();
+    Packet.Probabilities.SetNumUninitialized(NumFaces * FDnnEmotionClassifier::NumEmotions);
+    for (int32 FaceIndex = 0; FaceIndex < NumFaces; FaceIndex++)
     {
-        EFacialEmotion CurrentEmotion = DetectedEmotions[0].Emotion;
-        if (CurrentEmotion != LastDetectedEmotion)
+        float* Probabilities = Packet.Probabilities.GetData() + FaceIndex * FDnnEmotionClassifier::NumEmotions;
+        const float Confidence = Packet.Confidences[FaceIndex];
+        for (int32 Emotion = 0; Emotion < FDnnEmotionClassifier::NumEmotions; Emotion++)
         {
-            LastDetectedEmotion = CurrentEmotion;
-            OnEmotionDetected(CurrentEmotion, DetectedEmotions[0].Confidence);
+            Probabilities[Emotion] = (1.0f - Confidence) / (FDnnEmotionClassifier::NumEmotions - 1);
         }
+        Probabilities[(int32)Packet.Emotions[FaceIndex]] = Confidence;
     }
-    
 }
 
-void AFaceTracker::EndPlay(const EEndPlayReason::Type EndPlayReason)
+void FVideoProcessingThread::AnnotateStage(FFaceFramePacket& Packet)
 {
-    Super::EndPlay(EndPlayReason);
-        
-    UE_LOG(LogTemp, Log, TEXT("Shutting down Facial Expression Tracker..."));
-    
-    // Stop thread
-    if (ProcessingThread)
+    if (Packet.bDropped)
     {
-        ProcessingThread->Stop();
+        return;
     }
     
-    if (Thread)
+    const int32 NumFaces = Packet.ScaledFaces.size();
+    
+    // Built once and never touched again after publishing
+    TSharedRef<FFaceEmotionSnapshot, ESPMode::ThreadSafe> Snapshot = MakeShared<FFaceEmotionSnapshot, ESPMode::ThreadSafe>();
+    Snapshot->Sequence = ++EmotionSequence;
+    Snapshot->Emotions.Reserve(NumFaces);
+    
+    for (int32 FaceIndex = 0; FaceIndex < NumFaces; FaceIndex++)
     {
-        Thread->WaitForCompletion();
-        delete Thread;
-        Thread = nullptr;
+        const cv::Rect& ScaledFace = Packet.ScaledFaces[FaceIndex];
+        
+        // Filter out single-frame flicker, each face ID keeps its own history
+        const int32 FaceId = Packet.FaceIds[FaceIndex];
+        float Smoothed[FEmotionSmoother::NumEmotions];
+        const EFacialEmotion Emotion = (EFacialEmotion)EmotionSmoother.Update(FaceId, Packet.Probabilities.GetData() + FaceIndex * FEmotionSmoother::NumEmotions, Smoothed);
+        const float Confidence = Smoothed[(int32)Emotion];
+        
+        // Create emotion data
+        FFacialEmotionData EmotionData;
+        EmotionData.FaceId = FaceId;
+        EmotionData.Emotion = Emotion;
+        EmotionData.Confidence = Confidence;
+        EmotionData.RawEmotion = Packet.Emotions[FaceIndex];
+        EmotionData.FaceCenter = FVector2D(
+            ScaledFace.x + ScaledFace.width / 2.0f,
+            ScaledFace.y + ScaledFace.height / 2.0f
+        );
+        EmotionData.FaceSize = ScaledFace.width;
+        EmotionData.FaceBox = FBox2D(FVector2D(ScaledFace.x, ScaledFace.y), FVector2D(ScaledFace.x + ScaledFace.width, ScaledFace.y + ScaledFace.height));
+        EmotionData.Probabilities.Append(Smoothed, FEmotionSmoother::NumEmotions);
+        Snapshot->Emotions.Add(EmotionData);
     }
     
-    if (ProcessingThread)
+    // A face briefly lost keeps its history as long as it keeps its ID
+    EmotionSmoother.EndFrame(FaceAssociator.GetSettings().MaxMissedFrames);
+    
+    const float LatencyMs = (float)((FPlatformTime::Seconds() - Packet.CaptureTime) * 1000.0);
+    PipelineLatencyMs.store(LatencyMs, std::memory_order_relaxed);
+    
+    if (EmotionRecorder)
     {
-        delete ProcessingThread;
-        ProcessingThread = nullptr;
+        RecordEmotions(Packet, *Snapshot, LatencyMs);
     }
     
-    // Release webcam
-    if (VideoCapture.isOpened())
+    // Publish the results, and drop the snapshot the game thread last skipped over on this thread
+    EmotionHandoff.GetWriteSlot() = Snapshot;
+    EmotionHandoff.Publish();
+    EmotionHandoff.GetWriteSlot().Reset();
+    
+    if (NumFaces > 0)
     {
-        VideoCapture.release();
-        UE_LOG(LogTemp, Log, TEXT("Webcam released"));
+        FScopeLock Lock(&EmotionMutex);
+        DebugFeatures = Packet.Features[0];
     }
     
-    // Clean up texture region
-    if (VideoUpdateTextureRegion)
+    // Colour is only produced for the preview, straight into a free upload buffer. Skip it if all of them are in flight
+    uint8* UploadBuffer = nullptr;
+    if (bPreviewEnabled.load(std::memory_order_relaxed) && UploadPool->FreeBuffers.Dequeue(UploadBuffer))
     {
-        delete VideoUpdateTextureRegion;
-        VideoUpdateTextureRegion = nullptr;
+        cv::Mat FrameBGRA(FrameHeight, FrameWidth, CV_8UC4, UploadBuffer);
+        if (!ConvertPreviewFrame(Packet, FrameBGRA))
+        {
+            ReleaseUploadBuffer(UploadBuffer);
+            return;
+        }
+        
+        // Uploaded unmirrored and without annotations, the video material flips U and the overlay widget draws the faces
+        UploadHandoff.GetWriteSlot() = UploadBuffer;
+        UploadHandoff.Publish();
+        
+        // Recycle a frame the game thread skipped over
+        uint8*& StaleBuffer = UploadHandoff.GetWriteSlot();
+        ReleaseUploadBuffer(StaleBuffer);
+        StaleBuffer = nullptr;
     }
-    
-    UE_LOG(LogTemp, Log, TEXT("Facial Expression Tracker shutdown complete"));
-    
 }
 
-void AFaceTracker::UpdateTexture(cv::Mat& Frame)
+bool FVideoProcessingThread::ConvertPreviewFrame(const FFaceFramePacket& Packet, cv::Mat& FrameBGRA)
 {
-    if (!VideoTexture || Frame.empty())
+    const cv::Mat* Frame = &Packet.Frame;
+    EFaceFrameFormat FrameFormat = Packet.FrameFormat;
+    
+    // The only full resolution decode of an MJPEG frame
+    if (FrameFormat == EFaceFrameFormat::Mjpeg)
     {
-        return;
+        FACE_PIPELINE_SCOPE(Timings, Decode);
+        cv::imdecode(Packet.Frame, cv::IMREAD_COLOR, &PreviewFrame);
+        Frame = &PreviewFrame;
+        FrameFormat = EFaceFrameFormat::Bgr;
     }
     
-    // Convert BGR to BGRA
-    cv::Mat FrameBGRA;
-    cv::cvtColor(Frame, FrameBGRA, cv::COLOR_BGR2BGRA);
-    
-    // Copy to buffer
-    FMemory::Memcpy(VideoBuffer.GetData(), FrameBGRA.data, VideoWidth * VideoHeight * 4);
+    if (Frame->cols != FrameBGRA.cols || Frame->rows != FrameBGRA.rows)
+    {
+        return false;
+    }
     
-    // Update texture on game thread
-    VideoTexture->UpdateTextureRegions(
-        0,
-        1,
-        VideoUpdateTextureRegion,
-        VideoWidth * 4,
-        4,
-        VideoBuffer.GetData()
-    );
-}
-
-FVideoProcessingThread::FVideoProcessingThread(cv::VideoCapture* InCapture, cv::CascadeClassifier* InFaceCascade,
-	cv::CascadeClassifier* InEyeCascade, cv::CascadeClassifier* InSmileCascade)
-: VideoCapture(InCapture)
-, FaceCascade(InFaceCascade)
-, EyeCascade(InEyeCascade)
-, SmileCascade(InSmileCascade)
-, bRunning(true)
-{
+    FACE_PIPELINE_SCOPE(Timings, Upload);
+    switch (FrameFormat)
+    {
+        case EFaceFrameFormat::Grey:
+            cv::cvtColor(*Frame, FrameBGRA, cv::COLOR_GRAY2BGRA);
+            break;
+        case EFaceFrameFormat::Yuyv:
+            cv::cvtColor(*Frame, FrameBGRA, cv::COLOR_YUV2BGRA_YUYV);
+            break;
+        default:
+            cv::cvtColor(*Frame, FrameBGRA, cv::COLOR_BGR2BGRA);
+            break;
+    }
+    return true;
 }
 
-FVideoProcessingThread::~FVideoProcessingThread()
+void FVideoProcessingThread::RecordEmotions(const FFaceFramePacket& Packet, const FFaceEmotionSnapshot& Snapshot, float LatencyMs)
 {
-	Stop();
+    const double Time = EmotionRecorder->GetRecordingTime(Packet.CaptureTime);
+    FrameRecords.Reset();
+    
+    // An empty frame still gets a record, so replay knows when faces left
+    const int32 NumRecords = FMath::Max(Snapshot.Emotions.Num(), 1);
+    for (int32 FaceIndex = 0; FaceIndex < NumRecords; FaceIndex++)
+    {
+        FFaceEmotionRecord& Record = FrameRecords.AddZeroed_GetRef();
+        Record.Time = Time;
+        Record.Sequence = Snapshot.Sequence;
+        Record.LatencyMs = LatencyMs;
+        if (FaceIndex < Snapshot.Emotions.Num())
+        {
+            const FFacialEmotionData& EmotionData = Snapshot.Emotions[FaceIndex];
+            const cv::Rect& ScaledFace = Packet.ScaledFaces[FaceIndex];
+            Record.FaceId = EmotionData.FaceId;
+            FMemory::Memcpy(Record.Probabilities, EmotionData.Probabilities.GetData(), sizeof(Record.Probabilities));
+            Record.FaceX = ScaledFace.x;
+            Record.FaceY = ScaledFace.y;
+            Record.FaceWidth = ScaledFace.width;
+            Record.FaceHeight = ScaledFace.height;
+            Record.Emotion = (uint8)EmotionData.Emotion;
+            Record.RawEmotion = (uint8)EmotionData.RawEmotion;
+        }
+    }
+    
+    EmotionRecorder->Append(FrameRecords.GetData(), FrameRecords.Num());
 }
 
-bool FVideoProcessingThread::Init()
+FFaceDetectionStats FVideoProcessingThread::GetDetectionStats() const
 {
-	UE_LOG(LogTemp, Log, TEXT("Video processing thread initialized"));
-	return true;
+    FFaceDetectionStats Stats;
+    Stats.ScannedPixels = LastScannedPixels.load(std::memory_order_relaxed);
+    Stats.Frames = DetectionFrames.load(std::memory_order_relaxed);
+    Stats.FullScans = FullScans.load(std::memory_order_relaxed);
+    Stats.AverageScannedPixels = Stats.Frames > 0 ? (float)((double)TotalScannedPixels.load(std::memory_order_relaxed) / Stats.Frames) : 0.0f;
+    return Stats;
 }
 
-uint32 FVideoProcessingThread::Run()
+void FVideoProcessingThread::SetQuality(const FFaceQualityLevel& InQuality)
 {
-	while (bRunning)
-	{
-		if (VideoCapture && VideoCapture->isOpened())
-		{
-		    ProcessFrame();
-		}
-
-	    if (GEngine)
-	    {
-	        GEngine->AddOnScreenDebugMessage(
-            -1,
-            .12f,
-            FColor::Cyan,
-            FString::Printf(TEXT("EyeApectRatio: %f"), EyeAspectRatio));
-
-	        GEngine->AddOnScreenDebugMessage(
-            -1,
-            .12f,
-            FColor::Blue,
-            FString::Printf(TEXT("RelativeEyeSize: %f"), RelativeEyeSize));
-
-	        GEngine->AddOnScreenDebugMessage(
-            -1,
-            .12f,
-            FColor::Green,
-            FString::Printf(TEXT("SmileIntensity: %f"), SmileIntensity));
-    
-	    }
-	    
-		// Control frame rate (30 FPS = ~33ms per frame)
-		FPlatformProcess::Sleep(0.033f);
-	}
-    
-	return 0;
+    FScopeLock Lock(&QualityMutex);
+    Quality = InQuality;
 }
 
-void FVideoProcessingThread::Stop()
+FFaceQualityLevel FVideoProcessingThread::GetQuality()
 {
-    bRunning = false;
+    FScopeLock Lock(&QualityMutex);
+    return Quality;
 }
 
-void FVideoProcessingThread::Exit()
+// Smallest face searched for, 40 pixels in the full frame
+static int32 GetMinFaceSize(const FFaceQualityLevel& FrameQuality)
 {
-    UE_LOG(LogTemp, Log, TEXT("Video processing thread exiting"));
+    return FMath::Max(8, FMath::RoundToInt(40.0f * FrameQuality.DetectionScale));
 }
 
-bool FVideoProcessingThread::GetProcessedFrame(cv::Mat& OutFrame)
+void FVideoProcessingThread::UpdateFaces(const cv::Mat& SmallFrame, const FFaceQualityLevel& FrameQuality, std::vector<cv::Rect>& OutFaces)
 {
-    FScopeLock Lock(&FrameMutex);
-    if (!ProcessedFrame.empty())
+    // Tracked rects from another detection scale are meaningless in this frame
+    if (FrameQuality.DetectionScale != TrackedDetectionScale)
     {
-        OutFrame = ProcessedFrame.clone();
-        return true;
+        TrackedFaces.Reset();
+        TrackedDetectionScale = FrameQuality.DetectionScale;
+    }
+    
+    int64 ScannedPixels = 0;
+    bool bRunDetection = DetectionSettings.Mode == EFaceDetectionMode::FullScan
+        || TrackedFaces.Num() == 0
+        || FramesSinceDetection >= DetectionSettings.DetectionInterval;
+    
+    // Follow the known faces, any lost face forces a full-frame scan
+    if (!bRunDetection && DetectionSettings.Mode == EFaceDetectionMode::DetectAndTrack)
+    {
+        FACE_PIPELINE_SCOPE(Timings, TrackFaces);
+        for (FTrackedFace& Face : TrackedFaces)
+        {
+            if (!TrackFace(SmallFrame, Face, ScannedPixels))
+            {
+                bRunDetection = true;
+                break;
+            }
+        }
+    }
+    else if (!bRunDetection && DetectionSettings.Mode == EFaceDetectionMode::LocalSearch)
+    {
+        FACE_PIPELINE_SCOPE(Timings, DetectFaces);
+        for (FTrackedFace& Face : TrackedFaces)
+        {
+            if (!SearchNearFace(SmallFrame, FrameQuality, Face, ScannedPixels))
+            {
+                bRunDetection = true;
+                break;
+            }
+        }
+    }
+    
+    if (bRunDetection)
+    {
+        FACE_PIPELINE_SCOPE(Timings, DetectFaces);
+        std::vector<cv::Rect> Detections;
+        const int32 MinFaceSize = GetMinFaceSize(FrameQuality);
+        Models->FaceDetector->Detect(SmallFrame, FrameQuality, cv::Size(MinFaceSize, MinFaceSize), cv::Size(), Detections);
+        RefreshTrackedFaces(SmallFrame, Detections);
+        FramesSinceDetection = 0;
+        ScannedPixels += SmallFrame.total();
+        FullScans++;
+    }
+    else
+    {
+        FramesSinceDetection++;
+    }
+    
+    LastScannedPixels = (int32)ScannedPixels;
+    TotalScannedPixels += ScannedPixels;
+    DetectionFrames++;
+    
+    OutFaces.clear();
+    for (const FTrackedFace& Face : TrackedFaces)
+    {
+        OutFaces.push_back(Face.Rect);
     }
-    return false;
 }
 
-TArray<FFacialEmotionData> FVideoProcessingThread::GetEmotionData()
+cv::Rect FVideoProcessingThread::GetSearchWindow(const cv::Mat& SmallFrame, const cv::Rect& FaceRect) const
 {
-    FScopeLock Lock(&EmotionMutex);
-    return EmotionResults;
+    const int32 MarginX = FMath::CeilToInt(FaceRect.width * (DetectionSettings.SearchWindowScale - 1.0f) * 0.5f);
+    const int32 MarginY = FMath::CeilToInt(FaceRect.height * (DetectionSettings.SearchWindowScale - 1.0f) * 0.5f);
+    cv::Rect SearchRect(FaceRect.x - MarginX, FaceRect.y - MarginY, FaceRect.width + MarginX * 2, FaceRect.height + MarginY * 2);
+    return SearchRect & cv::Rect(0, 0, SmallFrame.cols, SmallFrame.rows);
 }
 
-void FVideoProcessingThread::ProcessFrame()
+bool FVideoProcessingThread::TrackFace(const cv::Mat& SmallFrame, FTrackedFace& Face, int64& ScannedPixels) const
 {
-	cv::Mat Frame;
+    // Search a window around the last position
+    const cv::Rect SearchRect = GetSearchWindow(SmallFrame, Face.Rect);
+    ScannedPixels += SearchRect.area();
     
-    // Capture frame
-    if (!VideoCapture->read(Frame))
+    if (SearchRect.width < Face.Template.cols || SearchRect.height < Face.Template.rows)
     {
-        return;
+        return false;
     }
     
-    if (Frame.empty())
-    {
-        return;
-    }
+    cv::Mat MatchScores;
+    cv::matchTemplate(SmallFrame(SearchRect), Face.Template, MatchScores, cv::TM_CCOEFF_NORMED);
     
-    // Flip for mirror effect
-    cv::flip(Frame, Frame, 1);
+    double BestScore = 0.0;
+    cv::Point BestLocation;
+    cv::minMaxLoc(MatchScores, nullptr, &BestScore, nullptr, &BestLocation);
     
-    // Convert to grayscale
-    cv::Mat GrayFrame, SmallFrame;
-    cv::cvtColor(Frame, GrayFrame, cv::COLOR_BGR2GRAY);
+    Face.Confidence = static_cast<float>(BestScore);
+    if (Face.Confidence < DetectionSettings.MinTrackingConfidence)
+    {
+        return false;
+    }
     
-    // Resize for faster processing
-    cv::resize(GrayFrame, SmallFrame, cv::Size(), 0.5, 0.5);
-    cv::equalizeHist(SmallFrame, SmallFrame);
+    Face.Rect.x = SearchRect.x + BestLocation.x;
+    Face.Rect.y = SearchRect.y + BestLocation.y;
+    return true;
+}
+
+bool FVideoProcessingThread::SearchNearFace(const cv::Mat& SmallFrame, const FFaceQualityLevel& FrameQuality, FTrackedFace& Face, int64& ScannedPixels) const
+{
+    const cv::Rect SearchRect = GetSearchWindow(SmallFrame, Face.Rect);
+    ScannedPixels += SearchRect.area();
     
-    // Detect faces
-    std::vector<cv::Rect> Faces;
-    FaceCascade->detectMultiScale(SmallFrame, Faces, 1.1, 3, 0, cv::Size(20, 20));
+    // Only look for faces close to last frame's size
+    const int32 MinFaceSize = FMath::Max(GetMinFaceSize(FrameQuality), FMath::FloorToInt(Face.Rect.width / DetectionSettings.LocalSearchSizeTolerance));
+    const int32 MaxFaceSize = FMath::CeilToInt(Face.Rect.width * DetectionSettings.LocalSearchSizeTolerance);
+    if (SearchRect.width < MinFaceSize || SearchRect.height < MinFaceSize)
+    {
+        return false;
+    }
     
-    TArray<FFacialEmotionData> NewEmotions;
+    std::vector<cv::Rect> Detections;
+    Models->FaceDetector->Detect(SmallFrame(SearchRect), FrameQuality,
+        cv::Size(MinFaceSize, MinFaceSize), cv::Size(MaxFaceSize, MaxFaceSize), Detections);
     
-    for (size_t i = 0; i < Faces.size(); i++)
+    if (Detections.empty())
     {
-        // Scale back to original size
-        cv::Rect ScaledFace(Faces[i].x * 2, Faces[i].y * 2, 
-                           Faces[i].width * 2, Faces[i].height * 2);
-        
-        // Ensure face rect is within image bounds
-        ScaledFace.x = FMath::Max(0, ScaledFace.x);
-        ScaledFace.y = FMath::Max(0, ScaledFace.y);
-        ScaledFace.width = FMath::Min(ScaledFace.width, GrayFrame.cols - ScaledFace.x);
-        ScaledFace.height = FMath::Min(ScaledFace.height, GrayFrame.rows - ScaledFace.y);
-        
-        if (ScaledFace.width <= 0 || ScaledFace.height <= 0)
-        {
-            continue;
-        }
-        
-        // Get face region from original grayscale
-        cv::Mat FaceROI = GrayFrame(ScaledFace);
-        
-        // Detect emotion
-        float Confidence = 0.0f;
-        EFacialEmotion Emotion = DetectEmotion(FaceROI, ScaledFace, Confidence);
-        
-        // Create emotion data
-        FFacialEmotionData EmotionData;
-        EmotionData.Emotion = Emotion;
-        EmotionData.Confidence = Confidence;
-        EmotionData.FaceCenter = FVector2D(
-            ScaledFace.x + ScaledFace.width / 2.0f,
-            ScaledFace.y + ScaledFace.height / 2.0f
-        );
-        EmotionData.FaceSize = ScaledFace.width;
-        NewEmotions.Add(EmotionData);
-        
-        // Draw on frame
-        cv::Scalar Color;
-        std::string EmotionText;
-        
-        switch(Emotion)
-        {
-            case EFacialEmotion::Happy:
-                Color = cv::Scalar(0, 255, 0);
-                EmotionText = "Happy";
-                break;
-            case EFacialEmotion::Sad:
-                Color = cv::Scalar(255, 0, 0);
-                EmotionText = "Sad";
-                break;
-            case EFacialEmotion::Angry:
-                Color = cv::Scalar(0, 0, 255);
-                EmotionText = "Angry";
-                break;
-            case EFacialEmotion::Surprised:
-                Color = cv::Scalar(255, 255, 0);
-                EmotionText = "Surprised";
-                break;
-            case EFacialEmotion::Fearful:
-                Color = cv::Scalar(255, 0, 255);
-                EmotionText = "Fearful";
-                break;
-            case EFacialEmotion::Disgusted:
-                Color = cv::Scalar(128, 0, 128);
-                EmotionText = "Disgusted";
-                break;
-            default:
-                Color = cv::Scalar(128, 128, 128);
-                EmotionText = "Neutral";
-                break;
-        }
-        
-        // Draw rectangle around face
-        cv::rectangle(Frame, ScaledFace, Color, 3);
-        
-        // Draw emotion label
-        cv::putText(Frame, EmotionText, 
-                   cv::Point(ScaledFace.x, ScaledFace.y - 10),
-                   cv::FONT_HERSHEY_SIMPLEX, 0.9, Color, 2);
-        
-        // Draw confidence
-        std::string ConfidenceText = "Conf: " + std::to_string((int)(Confidence * 100)) + "%";
-        cv::putText(Frame, ConfidenceText,
-                   cv::Point(ScaledFace.x, ScaledFace.y + ScaledFace.height + 25),
-                   cv::FONT_HERSHEY_SIMPLEX, 0.6, Color, 2);
+        return false;
     }
     
-    // Update emotion results thread-safely
+    // Keep the detection closest to where the face was
+    const cv::Point LastCenter = (Face.Rect.tl() + Face.Rect.br()) / 2;
+    cv::Rect BestRect;
+    int32 BestDistance = MAX_int32;
+    for (const cv::Rect& Detection : Detections)
     {
-        FScopeLock Lock(&EmotionMutex);
-        EmotionResults = NewEmotions;
+        const cv::Rect Candidate = Detection + SearchRect.tl();
+        const cv::Point Offset = (Candidate.tl() + Candidate.br()) / 2 - LastCenter;
+        const int32 Distance = Offset.dot(Offset);
+        if (Distance < BestDistance)
+        {
+            BestDistance = Distance;
+            BestRect = Candidate;
+        }
     }
     
-    // Update processed frame thread-safely
+    Face.Rect = BestRect;
+    return true;
+}
+
+void FVideoProcessingThread::RefreshTrackedFaces(const cv::Mat& SmallFrame, const std::vector<cv::Rect>& Detections)
+{
+    // The template is taken at detection time and kept until the next detection, so tracking can't drift
+    TrackedFaces.Reset();
+    for (const cv::Rect& Detection : Detections)
     {
-        FScopeLock Lock(&FrameMutex);
-        ProcessedFrame = Frame.clone();
+        FTrackedFace& Face = TrackedFaces.AddDefaulted_GetRef();
+        Face.Rect = Detection;
+        if (DetectionSettings.Mode == EFaceDetectionMode::DetectAndTrack)
+        {
+            Face.Template = SmallFrame(Detection).clone();
+        }
+        Face.Confidence = 1.0f;
     }
 }
 
-EFacialEmotion FVideoProcessingThread::DetectEmotion(const cv::Mat& FaceROI, const cv::Rect& FaceRect, float& OutConfidence)
+EFacialEmotion FVideoProcessingThread::DetectEmotion(const cv::Mat& FaceROI, const cv::Rect& FaceRect, float GrayScale, FFaceFeatureCascades& Cascades,
+	FFaceFeatures& OutFeatures, float& OutConfidence) const
 {
+    // Minimum feature sizes are in full frame pixels, a reduced MJPEG decode shrinks faces by GrayScale
+    const int32 MinEyeSize = FMath::Max(1, FMath::RoundToInt(15 * GrayScale));
+    const int32 MinSmileSize = FMath::Max(1, FMath::RoundToInt(25 * GrayScale));
+    
 	// Detect eyes in the face region
     std::vector<cv::Rect> Eyes;
-    EyeCascade->detectMultiScale(FaceROI, Eyes, 1.1, 3, 0, cv::Size(15, 15));
+    {
+        FACE_PIPELINE_SCOPE(Timings, DetectEyes);
+        Cascades.EyeCascade.detectMultiScale(FaceROI, Eyes, 1.1, 3, 0, cv::Size(MinEyeSize, MinEyeSize));
+    }
     
     // Detect smile in the lower half of face
     cv::Rect LowerFaceRect(0, FaceROI.rows / 2, FaceROI.cols, FaceROI.rows / 2);
     cv::Mat LowerFaceROI = FaceROI(LowerFaceRect);
     
     std::vector<cv::Rect> Smiles;
-    SmileCascade->detectMultiScale(LowerFaceROI, Smiles, 1.8, 20, 0, cv::Size(25, 25));
+    {
+        FACE_PIPELINE_SCOPE(Timings, DetectSmile);
+        Cascades.SmileCascade.detectMultiScale(LowerFaceROI, Smiles, 1.8, 20, 0, cv::Size(MinSmileSize, MinSmileSize));
+    }
     
     // Calculate features
-    HasSmile = Smiles.size() > 0;
-    HasBothEyes = Eyes.size() >= 2;
-    HasOneEye = Eyes.size() == 1;
-    HasNoEyes = Eyes.size() == 0;
+    FACE_PIPELINE_SCOPE(Timings, Classify);
+    const bool HasSmile = Smiles.size() > 0;
+    const bool HasBothEyes = Eyes.size() >= 2;
+    const bool HasOneEye = Eyes.size() == 1;
+    const bool HasNoEyes = Eyes.size() == 0;
+    
+    OutFeatures.NumEyes = Eyes.size();
+    OutFeatures.bHasSmile = HasSmile;
     
     // Calculate eye characteristics
     float AvgEyeHeight = 0.0f;
@@ -467,14 +1669,14 @@ EFacialEmotion FVideoProcessingThread::DetectEmotion(const cv::Mat& FaceROI, con
     }
     
     // Eye aspect ratio (height/width) - wider eyes have higher ratio
-    EyeAspectRatio = AvgEyeWidth > 0 ? AvgEyeHeight / AvgEyeWidth : 0.0f;
+    const float EyeAspectRatio = AvgEyeWidth > 0 ? AvgEyeHeight / AvgEyeWidth : 0.0f;
     
     // Relative eye size compared to face
-    RelativeEyeSize = FaceRect.height > 0 ? AvgEyeHeight / FaceRect.height : 0.0f;
+    const float RelativeEyeSize = FaceRect.height > 0 ? AvgEyeHeight / FaceRect.height : 0.0f;
     
     // Smile characteristics
-    SmileWidth = 0.0f;
-    SmileHeight = 0.0f;
+    float SmileWidth = 0.0f;
+    float SmileHeight = 0.0f;
     
     if (HasSmile)
     {
@@ -487,7 +1689,13 @@ EFacialEmotion FVideoProcessingThread::DetectEmotion(const cv::Mat& FaceROI, con
         SmileHeight /= Smiles.size();
     }
     
-    SmileIntensity = Smiles.size();
+    const float SmileIntensity = Smiles.size();
+    
+    OutFeatures.EyeAspectRatio = EyeAspectRatio;
+    OutFeatures.RelativeEyeSize = RelativeEyeSize;
+    OutFeatures.SmileIntensity = SmileIntensity;
+    OutFeatures.SmileWidth = SmileWidth;
+    OutFeatures.SmileHeight = SmileHeight;
     
     // Emotion classification logic
     EFacialEmotion DetectedEmotion = EFacialEmotion::Neutral;
@@ -533,4 +1741,93 @@ EFacialEmotion FVideoProcessingThread::DetectEmotion(const cv::Mat& FaceROI, con
     return DetectedEmotion;
 }
 
+// Centre of a run of landmarks
+static FVector2f GetLandmarkCentre(const FVector2f* Landmarks, int32 First, int32 Last)
+{
+    FVector2f Centre = FVector2f::ZeroVector;
+    for (int32 Index = First; Index <= Last; Index++)
+    {
+        Centre += Landmarks[Index];
+    }
+    return Centre / (float)(Last - First + 1);
+}
+
+// Eye aspect ratio of a six point eye, (|p1-p5| + |p2-p4|) / 2|p0-p3|. Falls as the eye closes
+static float GetEyeAspectRatio(const FVector2f* Eye)
+{
+    const float Width = FVector2f::Distance(Eye[0], Eye[3]);
+    return Width > 0.0f ? (FVector2f::Distance(Eye[1], Eye[5]) + FVector2f::Distance(Eye[2], Eye[4])) / (2.0f * Width) : 0.0f;
+}
 
+EFacialEmotion FVideoProcessingThread::DetectEmotionFromLandmarks(const FVector2f* Landmarks, const cv::Rect& FaceRect,
+	FFaceFeatures& OutFeatures, float& OutConfidence)
+{
+    // iBUG 68 layout: brows 17-26, eyes 36-47, outer lips 48-59, inner lips 60-67
+    const FVector2f LeftEyeCentre = GetLandmarkCentre(Landmarks, 36, 41);
+    const FVector2f RightEyeCentre = GetLandmarkCentre(Landmarks, 42, 47);
+    const float EyeDistance = FMath::Max(FVector2f::Distance(LeftEyeCentre, RightEyeCentre), 1.0f);
+    
+    // Eyes
+    const float EyeAspectRatio = (GetEyeAspectRatio(Landmarks + 36) + GetEyeAspectRatio(Landmarks + 42)) * 0.5f;
+    const float EyeHeight = (FVector2f::Distance(Landmarks[37], Landmarks[41]) + FVector2f::Distance(Landmarks[44], Landmarks[46])) * 0.5f;
+    
+    // Brows above the eyes, relative to eye spacing so it doesn't depend on face size
+    const float BrowDistance = (GetLandmarkCentre(Landmarks, 36, 47).Y - GetLandmarkCentre(Landmarks, 17, 26).Y) / EyeDistance;
+    
+    // Mouth opening, width, and how far the corners sit above the middle of the lips
+    const float MouthWidth = FVector2f::Distance(Landmarks[48], Landmarks[54]);
+    const float MouthHeight = (FVector2f::Distance(Landmarks[61], Landmarks[67]) + FVector2f::Distance(Landmarks[62], Landmarks[66])
+        + FVector2f::Distance(Landmarks[63], Landmarks[65])) / 3.0f;
+    const float InnerMouthWidth = FVector2f::Distance(Landmarks[60], Landmarks[64]);
+    const float MouthAspectRatio = InnerMouthWidth > 0.0f ? MouthHeight / InnerMouthWidth : 0.0f;
+    const float MouthCornerLift = ((Landmarks[51].Y + Landmarks[57].Y) - (Landmarks[48].Y + Landmarks[54].Y)) * 0.5f / EyeDistance;
+    const float RelativeMouthWidth = MouthWidth / EyeDistance;
+    
+    OutFeatures.NumEyes = 2;
+    OutFeatures.EyeAspectRatio = EyeAspectRatio;
+    OutFeatures.RelativeEyeSize = FaceRect.height > 0 ? EyeHeight / FaceRect.height : 0.0f;
+    OutFeatures.SmileIntensity = FMath::Max(MouthCornerLift, 0.0f) * RelativeMouthWidth;
+    OutFeatures.SmileWidth = MouthWidth;
+    OutFeatures.SmileHeight = MouthHeight;
+    OutFeatures.MouthAspectRatio = MouthAspectRatio;
+    OutFeatures.BrowDistance = BrowDistance;
+    OutFeatures.MouthCornerLift = MouthCornerLift;
+    OutFeatures.bHasSmile = MouthCornerLift > 0.05f && RelativeMouthWidth > 0.95f;
+    
+    // Emotion classification logic, thresholds are relative to eye spacing
+    
+    // Surprised: mouth open and brows raised
+    if (MouthAspectRatio > 0.5f && BrowDistance > 0.45f)
+    {
+        OutConfidence = FMath::Clamp(0.55f + (MouthAspectRatio - 0.5f), 0.0f, 0.95f);
+        return EFacialEmotion::Surprised;
+    }
+    // Happy: corners lifted and mouth stretched
+    if (OutFeatures.bHasSmile)
+    {
+        OutConfidence = FMath::Clamp(0.6f + MouthCornerLift * 2.0f, 0.0f, 0.95f);
+        return EFacialEmotion::Happy;
+    }
+    // Fearful: eyes wide and brows raised, mouth not fully open
+    if (EyeAspectRatio > 0.32f && BrowDistance > 0.45f)
+    {
+        OutConfidence = FMath::Clamp(0.5f + (EyeAspectRatio - 0.32f) * 2.0f, 0.0f, 0.9f);
+        return EFacialEmotion::Fearful;
+    }
+    // Angry: brows pulled down and eyes narrowed
+    if (BrowDistance < 0.3f && EyeAspectRatio < 0.22f)
+    {
+        OutConfidence = FMath::Clamp(0.55f + (0.3f - BrowDistance), 0.0f, 0.9f);
+        return EFacialEmotion::Angry;
+    }
+    // Sad: corners drooping below the middle of the lips
+    if (MouthCornerLift < -0.05f)
+    {
+        OutConfidence = FMath::Clamp(0.5f - MouthCornerLift * 2.0f, 0.0f, 0.9f);
+        return EFacialEmotion::Sad;
+    }
+    
+    // Neutral: Default state
+    OutConfidence = 0.6f;
+    return EFacialEmotion::Neutral;
+}
@@ -7,12 +7,28 @@
 
 #include "OpenCVHelper.h"
 #include "Engine/Texture2D.h"
+#include "Materials/MaterialInstanceDynamic.h"
 
 #include "MediaCapture.h"
 #include "IMediaEventSink.h"
 
 #include "HAL/Runnable.h"
 #include "HAL/RunnableThread.h"
+#include "Containers/Queue.h"
+#include "Async/Future.h"
+
+#include "FaceTripleBuffer.h"
+#include "FaceStageQueue.h"
+#include "FaceFrameSource.h"
+#include "FaceFrameScheduler.h"
+#include "FaceQualityController.h"
+#include "FaceDetector.h"
+#include "FaceEmotionClassifier.h"
+#include "FaceLandmarks.h"
+#include "FaceEmotionSmoothing.h"
+#include "FaceAssociation.h"
+#include "FaceEmotionLog.h"
+#include "FacePipelineProfiling.h"
 
 #include "PreOpenCVHeaders.h"
 #include "opencv2/opencv.hpp"
@@ -22,6 +38,7 @@
 
 #include "FaceTracker.generated.h"
 
+class UFaceTrackerOverlay;
 
 UENUM(BlueprintType)
 enum class EFacialEmotion : uint8
@@ -41,18 +58,104 @@ struct FFacialEmotionData
 {
 	GENERATED_BODY()
     
+	// Stays the same while the face is tracked, never reused for another face
+	UPROPERTY(BlueprintReadOnly)
+	int32 FaceId = 0;
+    
+	// Smoothed over the last frames, only changes on a stable transition
 	UPROPERTY(BlueprintReadOnly)
 	EFacialEmotion Emotion = EFacialEmotion::Neutral;
     
 	UPROPERTY(BlueprintReadOnly)
 	float Confidence = 0.0f;
     
+	// This frame's classification before smoothing
+	UPROPERTY(BlueprintReadOnly)
+	EFacialEmotion RawEmotion = EFacialEmotion::Neutral;
+    
 	UPROPERTY(BlueprintReadOnly)
 	FVector2D FaceCenter = FVector2D::ZeroVector;
     
 	UPROPERTY(BlueprintReadOnly)
 	float FaceSize = 0.0f;
 	
+	// Face rect in video pixels, in the mirrored frame like FaceCenter
+	UPROPERTY(BlueprintReadOnly)
+	FBox2D FaceBox = FBox2D(ForceInit);
+	
+	// Smoothed probability of each emotion, indexed by EFacialEmotion
+	UPROPERTY(BlueprintReadOnly)
+	TArray<float> Probabilities;
+	
+};
+
+
+UENUM(BlueprintType)
+enum class EFaceDetectionMode : uint8
+{
+	// Run the face cascade over the whole frame every frame
+	FullScan        UMETA(DisplayName = "Full Scan"),
+	// Run the face cascade every few frames and track faces in between
+	DetectAndTrack  UMETA(DisplayName = "Detect And Track"),
+	// Run the face cascade only around last frame's faces, with a periodic full-frame rescan
+	LocalSearch     UMETA(DisplayName = "Local Search")
+};
+
+
+USTRUCT(BlueprintType)
+struct FFaceDetectionSettings
+{
+	GENERATED_BODY()
+	
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Detection")
+	EFaceDetectorBackend Backend = EFaceDetectorBackend::HaarCascade;
+	
+	// Minimum SSD score for a detection to count as a face
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Detection", meta = (EditCondition = "Backend == EFaceDetectorBackend::DnnSsd", ClampMin = 0, ClampMax = 1))
+	float DnnConfidenceThreshold = 0.5f;
+	
+	// Square network input, smaller is faster but misses small faces
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Detection", meta = (EditCondition = "Backend == EFaceDetectorBackend::DnnSsd", ClampMin = 64, ClampMax = 640))
+	int32 DnnInputSize = 300;
+	
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Detection")
+	EFaceDetectionMode Mode = EFaceDetectionMode::DetectAndTrack;
+	
+	// Frames between two full-frame scans
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Detection", meta = (EditCondition = "Mode != EFaceDetectionMode::FullScan", ClampMin = 1, ClampMax = 60))
+	int32 DetectionInterval = 10;
+	
+	// Template match score below which a face counts as lost and a full detection is forced
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Detection", meta = (EditCondition = "Mode == EFaceDetectionMode::DetectAndTrack", ClampMin = 0, ClampMax = 1))
+	float MinTrackingConfidence = 0.6f;
+	
+	// Size of the window searched around last frame's face, relative to the face
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Detection", meta = (EditCondition = "Mode != EFaceDetectionMode::FullScan", ClampMin = 1, ClampMax = 4))
+	float SearchWindowScale = 1.5f;
+	
+	// How much a face may grow or shrink between frames in local search, bounds the cascade's min/max size
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Detection", meta = (EditCondition = "Mode == EFaceDetectionMode::LocalSearch", ClampMin = 1, ClampMax = 2))
+	float LocalSearchSizeTolerance = 1.3f;
+};
+
+
+USTRUCT(BlueprintType)
+struct FFaceDetectionStats
+{
+	GENERATED_BODY()
+	
+	// Detection-resolution pixels searched for faces on the last frame
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+	int32 ScannedPixels = 0;
+	
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+	float AverageScannedPixels = 0.0f;
+	
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+	int32 Frames = 0;
+	
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+	int32 FullScans = 0;
 };
 
 
@@ -96,15 +199,146 @@ struct FFacialEmotionData
 //};
 //
 
+// Cascades used to classify one face at a time, cv::CascadeClassifier can't be shared between threads
+struct FFaceFeatureCascades
+{
+	cv::CascadeClassifier EyeCascade;
+	cv::CascadeClassifier SmileCascade;
+};
+
+
+// Emotion results of one processed frame, never modified once published
+struct FFaceEmotionSnapshot
+{
+	// Increases by one with every published frame
+	uint64 Sequence = 0;
+	TArray<FFacialEmotionData> Emotions;
+};
+
+typedef TSharedPtr<const FFaceEmotionSnapshot, ESPMode::ThreadSafe> FFaceEmotionSnapshotPtr;
+
+
+// Models shared by the worker thread
+struct FFaceTrackerModels
+{
+	// Only used by the detection stage
+	TUniquePtr<IFaceDetector> FaceDetector;
+	
+	// Set when classifying with a CNN
+	TUniquePtr<FDnnEmotionClassifier> EmotionClassifier;
+	
+	// Set when classifying from landmark geometry. Without either, faces are classified from the feature cascades
+	TUniquePtr<FDnnFaceLandmarker> Landmarker;
+	
+	// One set per face classified concurrently
+	std::vector<FFaceFeatureCascades> FeatureCascades;
+	
+	// Load the face detector and emotion classifier, logs and returns false if any failed
+	bool Load(const FFaceDetectorConfig& DetectorConfig, const FEmotionClassifierSettings& ClassifierSettings,
+		const FString& EyeCascadePath, const FString& SmileCascadePath, int32 NumFeatureSlots);
+};
+
+typedef TSharedPtr<FFaceTrackerModels, ESPMode::ThreadSafe> FFaceTrackerModelsPtr;
+
+
+// Everything FFaceTrackerModels::Load needs, models loaded from equal configs are interchangeable
+struct FFaceModelConfig
+{
+	FFaceDetectorConfig Detector;
+	FEmotionClassifierSettings Classifier;
+	FString EyeCascadePath;
+	FString SmileCascadePath;
+	int32 NumFeatureSlots = 1;
+	
+	// Equal for equal configs
+	FString GetKey() const;
+};
+
+
+// Measurements taken from one face while classifying it
+struct FFaceFeatures
+{
+	int32 NumEyes = 0;
+	bool bHasSmile = false;
+	
+	float EyeAspectRatio = 0.0f;
+	float RelativeEyeSize = 0.0f;
+	float SmileIntensity = 0.0f;
+	float SmileWidth = 0.0f;
+	float SmileHeight = 0.0f;
+	
+	// Landmark geometry only, relative to the distance between the eye centres
+	float MouthAspectRatio = 0.0f;
+	float BrowDistance = 0.0f;
+	float MouthCornerLift = 0.0f;
+};
+
+
+// One frame moving through the processing stages
+struct FFaceFramePacket
+{
+	// Knobs in effect when the frame was captured, so every stage sees the same level
+	FFaceQualityLevel Quality;
+	double CaptureTime = 0.0;
+	
+	// As captured, only mirrored by the reference path
+	cv::Mat Frame;
+	EFaceFrameFormat FrameFormat = EFaceFrameFormat::Bgr;
+	// The frame couldn't be decoded, later stages pass the packet through untouched
+	bool bDropped = false;
+	// Mirrored luma, at full resolution unless MJPEG was decoded at reduced scale
+	cv::Mat GrayFrame;
+	// GrayFrame size relative to the full frame
+	float GrayScale = 1.0f;
+	cv::Mat SmallFrame;
+	
+	// Face rects in the mirrored full resolution frame, oldest track first
+	std::vector<cv::Rect> ScaledFaces;
+	// The same rects in GrayFrame, what the classifiers crop
+	std::vector<cv::Rect> GrayFaces;
+	// Stable ID of each face in ScaledFaces
+	TArray<int32> FaceIds;
+	
+	TArray<EFacialEmotion> Emotions;
+	TArray<float> Confidences;
+	TArray<FFaceFeatures> Features;
+	// FDnnEmotionClassifier::NumEmotions per face
+	TArray<float> Probabilities;
+	// FDnnFaceLandmarker::NumLandmarks per face, when classifying from landmarks
+	TArray<FVector2f> Landmarks;
+};
+
+typedef TFaceStageQueue<FFaceFramePacket*> FFacePacketQueue;
+
+class FFaceStageWorker;
+
+
+// BGRA upload buffers lent out for texture updates, with the region they cover. Pending texture updates
+// hold a reference, so the worker that filled them can be replaced without flushing the render thread
+struct FFaceUploadBufferPool
+{
+	FFaceUploadBufferPool(int32 Width, int32 Height, int32 NumBuffers);
+
+	FUpdateTextureRegion2D Region;
+	TArray<TArray<uint8>> Buffers;
+	TQueue<uint8*, EQueueMode::Mpsc> FreeBuffers;
+};
+
+typedef TSharedRef<FFaceUploadBufferPool, ESPMode::ThreadSafe> FFaceUploadBufferPoolRef;
+
+
 // Worker thread class
 
 class FVideoProcessingThread : public FRunnable
 {
 public:
-	FVideoProcessingThread(cv::VideoCapture* InCapture, 
-						  cv::CascadeClassifier* InFaceCascade,
-						  cv::CascadeClassifier* InEyeCascade,
-						  cv::CascadeClassifier* InSmileCascade);
+	FVideoProcessingThread(IFaceFrameSource* InFrameSource, 
+						  FFaceTrackerModels* InModels,
+						  int32 InFrameWidth,
+						  int32 InFrameHeight,
+						  const FFaceDetectionSettings& InDetectionSettings,
+						  float InTargetFrameRate,
+						  bool bInPipelineStages);
 	virtual ~FVideoProcessingThread();
 
 	// FRunnable interface
@@ -113,46 +347,190 @@ public:
 	virtual void Stop() override;
 	virtual void Exit() override;
 
-	// Get processed frame
-	bool GetProcessedFrame(cv::Mat& OutFrame);
+	// Take the latest BGRA frame, or nullptr if there is no new frame (game thread only).
+	// The caller owns the buffer until it is handed back to GetUploadPool()'s FreeBuffers, which may outlive the thread
+	uint8* AcquireUploadBuffer();
+	const FFaceUploadBufferPoolRef& GetUploadPool() const { return UploadPool; }
     
 	// Get emotion data
-	TArray<FFacialEmotionData> GetEmotionData();
+	// Game thread: latest snapshot if a new one was published since the last call, nullptr otherwise
+	FFaceEmotionSnapshotPtr ConsumeEmotionSnapshot();
+	
+	// Capture and process one frame through every stage on the calling thread, returns false if no frame was read or it couldn't be decoded.
+	// Run() calls this in a loop when stages aren't pipelined, the benchmark commandlet drives it directly.
+	bool ProcessFrame();
+	
+	// Faces found by the last ProcessFrame, in full resolution and oldest track first
+	const std::vector<cv::Rect>& GetLastFaces() const { return SyncPacket.ScaledFaces; }
+	
+	// Flip every whole captured frame, the way the tracker mirrored before only the luma frame was flipped.
+	// For the mirror automation test and the benchmark's -CompareMirror check, set before the first frame
+	void SetReferenceMirror(bool bEnabled) { bReferenceMirror = bEnabled; }
+	
+	// Equalized frame the last ProcessFrame ran detection on
+	const cv::Mat& GetLastDetectionFrame() const { return SyncPacket.SmallFrame; }
+	
+	// Attach per-stage timings for ProcessFrame, or nullptr to stop timing
+	void SetTimings(FFacePipelineTimings* InTimings);
+	
+	// Safe to call from any thread
+	FFaceDetectionStats GetDetectionStats() const;
+	FFaceSchedulerStats GetSchedulerStats() const { return Scheduler.GetStats(); }
+	
+	// Features of the first face of the last frame, for the debug HUD. Safe to call from any thread
+	FFaceFeatures GetDebugFeatures();
+	
+	// Capture to annotation time of the last frame
+	float GetPipelineLatencyMs() const { return PipelineLatencyMs.load(std::memory_order_relaxed); }
+	
+	// Skip the colour conversion and upload of every frame while nothing shows the preview, safe to call from any thread
+	void SetPreviewEnabled(bool bEnabled) { bPreviewEnabled.store(bEnabled, std::memory_order_relaxed); }
+	
+	// The frame source no longer delivers FrameWidth x FrameHeight, frames are skipped until the thread is replaced
+	bool HasFrameSizeChanged() const { return bFrameSizeChanged.load(std::memory_order_relaxed); }
+	
+	// Call before the thread starts
+	void SetEmotionSmoothing(const FEmotionSmoothingSettings& InSettings) { EmotionSmoother.SetSettings(InSettings); }
+	void SetFaceAssociation(const FFaceAssociationSettings& InSettings) { FaceAssociator.SetSettings(InSettings); }
+	// Log every annotated frame, the recorder must outlive the thread
+	void SetEmotionRecorder(FFaceEmotionRecorder* InRecorder) { EmotionRecorder = InRecorder; }
+	
+	// Picked up by the next captured frame
+	void SetQuality(const FFaceQualityLevel& InQuality);
+	FFaceQualityLevel GetQuality();
 	
 private:
-	cv::VideoCapture* VideoCapture;
-	cv::CascadeClassifier* FaceCascade;
-	cv::CascadeClassifier* EyeCascade;
-	cv::CascadeClassifier* SmileCascade;
+	IFaceFrameSource* FrameSource;
+	FFaceTrackerModels* Models;
+    
+	int32 FrameWidth;
+	int32 FrameHeight;
+
+	// Upload buffers the worker converts preview frames into, shared with pending texture updates
+	static constexpr int32 NumUploadBuffers = 4;
+	FFaceUploadBufferPoolRef UploadPool;
+	
+	void ReleaseUploadBuffer(uint8* Buffer);
+	
+	// Latest converted frame handed from the worker to the game thread
+	TFaceTripleBuffer<uint8*> UploadHandoff;
+	std::atomic<bool> bPreviewEnabled{true};
+	std::atomic<bool> bFrameSizeChanged{false};
     
-	cv::Mat CurrentFrame;
-	cv::Mat ProcessedFrame;
+	// A face followed between detections, in detection resolution
+	struct FTrackedFace
+	{
+		cv::Rect Rect;
+		cv::Mat Template;
+		float Confidence = 1.0f;
+	};
+	
+	FFaceDetectionSettings DetectionSettings;
+	TArray<FTrackedFace> TrackedFaces;
+	int32 FramesSinceDetection = 0;
+	// Detection scale the tracked rects are in
+	float TrackedDetectionScale = 0.0f;
+	
+	// Only used by the detection stage, gives faces their IDs
+	FFaceAssociator FaceAssociator;
+	
+	// Current quality level, set from the game thread
+	FCriticalSection QualityMutex;
+	FFaceQualityLevel Quality;
+	float TargetFrameRate;
+	std::atomic<float> PipelineLatencyMs{0.0f};
+	
+	// Last classification, reused on frames that skip the eye and smile cascades
+	int32 FramesSinceFeatures = 0;
+	TArray<int32> LastFaceIds;
+	TArray<EFacialEmotion> LastEmotions;
+	TArray<float> LastConfidences;
+	TArray<FFaceFeatures> LastFeatures;
+	TArray<float> LastProbabilities;
+	
+	std::atomic<int32> LastScannedPixels { 0 };
+	std::atomic<int64> TotalScannedPixels { 0 };
+	std::atomic<int32> DetectionFrames { 0 };
+	std::atomic<int32> FullScans { 0 };
     
-	FCriticalSection FrameMutex;
 	FCriticalSection EmotionMutex;
 	FThreadSafeBool bRunning;
+	
+	// Paces Run() to the target frame rate
+	FFaceFrameScheduler Scheduler;
+	
+	// Capture, preprocessing, detection, classification and annotation each run on their own thread,
+	// connected by single-slot queues so frame N+1 is captured while frame N is still being classified
+	bool bPipelineStages;
+	bool bReferenceMirror = false;
+	FFacePacketQueue PreprocessQueue;
+	FFacePacketQueue DetectQueue;
+	FFacePacketQueue ClassifyQueue;
+	FFacePacketQueue AnnotateQueue;
+	
+	// Packets returned by the annotation stage for the capture stage to reuse
+	static constexpr int32 NumPipelinePackets = 8;
+	TArray<TUniquePtr<FFaceFramePacket>> PacketPool;
+	FFacePacketQueue FreePackets;
+	FFaceFramePacket* CapturePacket = nullptr;
+	
+	TArray<TUniquePtr<FFaceStageWorker>> StageWorkers;
+	TArray<FRunnableThread*> StageThreads;
+	
+	// Used by ProcessFrame
+	FFaceFramePacket SyncPacket;
     
-	TArray<FFacialEmotionData> EmotionResults;
-
-	bool HasSmile;
-	bool HasBothEyes;
-	bool HasOneEye;
-	bool HasNoEyes;
-
-	float SmileWidth = 0.0f;
-	float SmileHeight = 0.0f;
+	// Latest results handed from the annotation stage to the game thread
+	TFaceTripleBuffer<FFaceEmotionSnapshotPtr> EmotionHandoff;
+	uint64 EmotionSequence = 0;
 	
-	float EyeAspectRatio;
-	float RelativeEyeSize;
-	float SmileIntensity;
-	float BrowIntensity;
-	float MouthAspectRatio = 0.0f;
+	// Features of the first face, for the debug HUD
+	FFaceFeatures DebugFeatures;
 	
-	TArray<EFacialEmotion> EmotionHistory;
-	const int HistorySize = 10;
+	// Only used by the annotation stage
+	FEmotionSmoother EmotionSmoother;
+	FFaceEmotionRecorder* EmotionRecorder = nullptr;
+	TArray<FFaceEmotionRecord> FrameRecords;
+	// Full decode of a previewed MJPEG frame
+	cv::Mat PreviewFrame;
 	
-	void ProcessFrame();
-	EFacialEmotion DetectEmotion(const cv::Mat& FaceROI, const cv::Rect& FaceRect, float& OutConfidence);
+	FFacePipelineTimings* Timings = nullptr;
+	
+	void StartStageWorkers();
+	void StopStageWorkers();
+	// Capture into a free packet and hand it to preprocessing, returns false if nothing was captured
+	bool CaptureIntoPipeline();
+	
+	bool CaptureStage(FFaceFramePacket& Packet);
+	void PreprocessStage(FFaceFramePacket& Packet);
+	void DetectStage(FFaceFramePacket& Packet);
+	void ClassifyStage(FFaceFramePacket& Packet);
+	void AnnotateStage(FFaceFramePacket& Packet);
+	void RecordEmotions(const FFaceFramePacket& Packet, const FFaceEmotionSnapshot& Snapshot, float LatencyMs);
+	// Colour the captured frame into a full resolution BGRA buffer, false if it doesn't fit
+	bool ConvertPreviewFrame(const FFaceFramePacket& Packet, cv::Mat& FrameBGRA);
+	
+	// Classification backends, called from ClassifyStage
+	void ClassifyBatch(FFaceFramePacket& Packet);
+	void ClassifyFromFeatures(FFaceFramePacket& Packet);
+	void ClassifyFromLandmarks(FFaceFramePacket& Packet);
+	
+	// Rule-based backends pick a single emotion, spread the rest of its confidence over the others
+	static void SpreadConfidence(FFaceFramePacket& Packet);
+	
+	static EFacialEmotion DetectEmotionFromLandmarks(const FVector2f* Landmarks, const cv::Rect& FaceRect, FFaceFeatures& OutFeatures, float& OutConfidence);
+	
+	// Find faces in the equalized detection frame, by full detection or by tracking
+	void UpdateFaces(const cv::Mat& SmallFrame, const FFaceQualityLevel& FrameQuality, std::vector<cv::Rect>& OutFaces);
+	cv::Rect GetSearchWindow(const cv::Mat& SmallFrame, const cv::Rect& FaceRect) const;
+	bool TrackFace(const cv::Mat& SmallFrame, FTrackedFace& Face, int64& ScannedPixels) const;
+	bool SearchNearFace(const cv::Mat& SmallFrame, const FFaceQualityLevel& FrameQuality, FTrackedFace& Face, int64& ScannedPixels) const;
+	void RefreshTrackedFaces(const cv::Mat& SmallFrame, const std::vector<cv::Rect>& Detections);
+	
+	// Re-entrant, each concurrent call needs its own cascades. GrayScale is the size of FaceROI's frame relative
+	// to the full frame, the eye and smile minimum sizes shrink with it
+	EFacialEmotion DetectEmotion(const cv::Mat& FaceROI, const cv::Rect& FaceRect, float GrayScale, FFaceFeatureCascades& Cascades,
+								 FFaceFeatures& OutFeatures, float& OutConfidence) const;
 };
  
 
@@ -173,15 +551,69 @@ public:
 	UFUNCTION(BlueprintImplementableEvent, Category = "Facial Tracking")
 	void OnEmotionDetected(EFacialEmotion Emotion, float Confidence);
     
+	// Fires when a face appears, and on each stable emotion transition of that face
+	UFUNCTION(BlueprintImplementableEvent, Category = "Facial Tracking")
+	void OnFaceEmotionChanged(int32 FaceId, EFacialEmotion Emotion, float Confidence);
+    
+	// Fires once the face has been out of view for longer than FaceAssociation.MaxMissedFrames
+	UFUNCTION(BlueprintImplementableEvent, Category = "Facial Tracking")
+	void OnFaceLost(int32 FaceId);
+    
+	// Fires on the game thread whenever the shared webcam opens, streams, is lost or reconnects
+	UFUNCTION(BlueprintImplementableEvent, Category = "Facial Tracking")
+	void OnCameraStateChanged(EFaceCameraState State);
+    
+	// Recorded sources are Streaming once open
+	UFUNCTION(BlueprintPure, Category = "Facial Tracking")
+	EFaceCameraState GetCameraState() const;
+    
+	// Null until the camera first streams, replaced if it reconnects at another size
 	UFUNCTION(BlueprintCallable, Category = "Facial Tracking")
 	UTexture2D* GetVideoTexture() const { return VideoTexture; }
+	
+	// Instance of VideoMaterial showing VideoTexture mirrored, null until the camera first streams
+	UFUNCTION(BlueprintCallable, Category = "Facial Tracking")
+	UMaterialInstanceDynamic* GetVideoMaterial() const { return VideoMaterialInstance; }
+	
+	// VideoTexture is uploaded unmirrored, UV * RG + BA shows it mirrored. For materials other than VideoMaterial
+	UFUNCTION(BlueprintPure, Category = "Facial Tracking")
+	FLinearColor GetVideoUVTransform() const { return FLinearColor(-1.0f, 1.0f, 1.0f, 0.0f); }
+
+	// Show or hide the viewport overlay, creating it the first time it is shown
+	UFUNCTION(BlueprintCallable, Category = "Facial Tracking")
+	void SetOverlayVisible(bool bVisible);
 
+	// Faces of the latest processed frame, read straight from the published snapshot
+	UFUNCTION(BlueprintCallable, Category = "Face Tracking")
+	const TArray<FFacialEmotionData>& GetDetectedEmotions() const;
+	
+	// Changes whenever GetDetectedEmotions does, lets Blueprint skip work on unchanged results
+	UFUNCTION(BlueprintPure, Category = "Face Tracking")
+	int64 GetEmotionSequence() const { return EmotionSnapshot ? (int64)EmotionSnapshot->Sequence : 0; }
+	
+	// Latest data of one face, false if the face isn't in view this frame
 	UFUNCTION(BlueprintCallable, Category = "Face Tracking")
-	TArray<FFacialEmotionData> GetDetectedEmotions() const { return DetectedEmotions; }
+	bool GetFaceEmotion(int32 FaceId, FFacialEmotionData& OutData) const;
 
 	
 	UPROPERTY(BlueprintReadOnly, Category = "Facial Tracking")
 	UTexture2D* VideoTexture;
+	
+	// Material for the preview, given VideoTexture through its VideoTexture parameter and mirrored by setting its
+	// MirrorU scalar parameter to 1. Content/Python/add_video_mirror_parameter.py adds MirrorU to a material
+	UPROPERTY(EditAnywhere, Category = "Facial Tracking")
+	UMaterialInterface* VideoMaterial;
+	
+	UPROPERTY(BlueprintReadOnly, Category = "Facial Tracking")
+	UMaterialInstanceDynamic* VideoMaterialInstance;
+	
+	// Overlay added to the viewport on BeginPlay, showing the preview with the face boxes drawn over it. None by default,
+	// SetOverlayVisible adds a plain UFaceTrackerOverlay at runtime if this is unset
+	UPROPERTY(EditAnywhere, Category = "Facial Tracking")
+	TSubclassOf<UFaceTrackerOverlay> OverlayWidgetClass;
+	
+	UPROPERTY(BlueprintReadOnly, Category = "Facial Tracking")
+	UFaceTrackerOverlay* OverlayWidget;
     
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Facial Tracking")
 	int32 VideoWidth;
@@ -189,12 +621,44 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Facial Tracking")
 	int32 VideoHeight;
     
-	UPROPERTY(BlueprintReadOnly, Category = "Facial Tracking")
-	TArray<FFacialEmotionData> DetectedEmotions;
+	// Convert camera frames to colour and upload them to VideoTexture. Face tracking runs either way
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Facial Tracking")
+	bool bUploadPreview = true;
     
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Performance")
 	int32 TargetFPS = 30;
     
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Performance")
+	FFaceDetectionSettings DetectionSettings;
+    
+	// Run capture, preprocessing, detection, classification and annotation on separate threads
+	UPROPERTY(EditAnywhere, Category = "Performance")
+	bool bPipelineStages = true;
+    
+	// Faces classified in parallel, each slot loads its own eye and smile cascades
+	UPROPERTY(EditAnywhere, Category = "Performance", meta = (ClampMin = 1, ClampMax = 8))
+	int32 MaxParallelFaces = 4;
+    
+	UPROPERTY(BlueprintReadOnly, Category = "Performance")
+	FFaceDetectionStats DetectionStats;
+    
+	// Frames late against TargetFPS and frames dropped to catch up
+	UPROPERTY(BlueprintReadOnly, Category = "Performance")
+	FFaceSchedulerStats SchedulerStats;
+    
+	// Lowers detection resolution, cascade precision, classification frequency and worker rate
+	// when the game thread or the face pipeline run over budget
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Performance")
+	FFaceQualityPolicy QualityPolicy;
+    
+	// 0 at QualityPolicy.LowQuality, 1 at QualityPolicy.HighQuality
+	UPROPERTY(BlueprintReadOnly, Category = "Performance")
+	float CurrentQuality = 1.0f;
+    
+	// Webcam, or a recorded clip for running without a camera
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Facial Tracking")
+	FFaceFrameSourceSettings CaptureSettings;
+    
 	//UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Performance")
 	//float DetectionScale = 0.5f;
     
@@ -207,20 +671,94 @@ public:
     
 	UPROPERTY(EditAnywhere, Category = "Facial Tracking")
 	FString SmileCascadePath;
+    
+	// Face detector used when DetectionSettings.Backend is DnnSsd
+	UPROPERTY(EditAnywhere, Category = "Facial Tracking")
+	FString DnnFaceModelPath;
+    
+	// Caffe prototxt for DnnFaceModelPath, leave empty for ONNX models
+	UPROPERTY(EditAnywhere, Category = "Facial Tracking")
+	FString DnnFaceConfigPath;
+    
+	// Face detector selected by DetectionSettings
+	FFaceDetectorConfig GetDetectorConfig() const;
+    
+	// Detector, classifier and cascades this tracker needs
+	FFaceModelConfig GetModelConfig() const;
+    
+	// Haar feature rules, or a CNN classifying all faces of a frame at once
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Facial Tracking")
+	FEmotionClassifierSettings EmotionClassifier;
+    
+	// Per-face filtering so OnEmotionDetected only fires on stable transitions, not single-frame flicker
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Facial Tracking")
+	FEmotionSmoothingSettings EmotionSmoothing;
+	
+	// Matches faces between frames so each player keeps their FaceId and emotion history
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Facial Tracking")
+	FFaceAssociationSettings FaceAssociation;
+	
+	// Record emotion traces of a session, or replay one in place of the camera
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Facial Tracking")
+	FFaceEmotionLogSettings EmotionLog;
 	
 	UPROPERTY(BlueprintReadOnly, Category = "Facial Tracking")
 	EFacialEmotion LastDetectedEmotion;
 
 private:
-	cv::VideoCapture VideoCapture;
-	cv::CascadeClassifier FaceCascade;
-	cv::CascadeClassifier EyeCascade;
-	cv::CascadeClassifier SmileCascade;
-    
-	void UpdateTexture(cv::Mat& Frame);
+	TUniquePtr<IFaceFrameSource> FrameSource;
+	FFaceQualityController QualityController;
+	
+	// Lent by UFaceModelSubsystem while the tracker runs
+	FFaceModelConfig ModelConfig;
+	FFaceTrackerModelsPtr Models;
+	TSharedFuture<FFaceTrackerModelsPtr> PendingModels;
+	// Cleared once the first start has reported the cold start time
+	double BeginPlayTime = 0.0;
+	
+	// Once the models are loaded and the frame source is streaming, does nothing until then
+	void StartProcessingThread();
+	
+	// Join and delete the worker, the models stay with the tracker
+	void StopProcessingThread();
+	
+	// For a frame source that changed size, e.g. a webcam reconnected to a different device
+	void RestartProcessingThread();
+	
+	// Point VideoMaterialInstance at VideoTexture, creating it on first use
+	void UpdateVideoMaterial();
+	
+	FDelegateHandle CameraStateHandle;
+	void HandleCameraStateChanged(int32 CameraIndex, EFaceCameraState State);
+	FFaceEmotionSnapshotPtr EmotionSnapshot;
+	
+	// Per-face channel state for OnFaceEmotionChanged and OnFaceLost
+	struct FFaceChannel
+	{
+		EFacialEmotion Emotion;
+		uint64 LastSequence;
+	};
+	TMap<int32, FFaceChannel> FaceChannels;
+	
+	// Make a new snapshot current and fire the emotion events, from the worker or a replay
+	void ApplyEmotionSnapshot(FFaceEmotionSnapshotPtr Snapshot);
+	
+	TUniquePtr<FFaceEmotionRecorder> EmotionRecorder;
+	
+	// Replay in place of the camera and worker thread
+	TUniquePtr<FFaceEmotionLogReader> EmotionReplay;
+	int32 ReplayIndex = 0;
+	double ReplayStartTime = 0.0;
+	// Keeps sequence numbers increasing across loops
+	uint64 ReplaySequenceOffset = 0;
+	
+	bool StartEmotionReplay();
+	void TickEmotionReplay();
     
-	FUpdateTextureRegion2D* VideoUpdateTextureRegion;
-	TArray<uint8> VideoBuffer;
+	void UpdateTexture(uint8* UploadBuffer);
+	
+	// Pipeline counters and features on screen, while FaceTracker.DebugHUD is set
+	void DrawDebugHUD();
     
 	// Threading
 	FVideoProcessingThread* ProcessingThread;
@@ -0,0 +1,391 @@
+
+#include "FaceTrackerBenchmarkCommandlet.h"
+#include "FaceTracker.h"
+#include "Dom/JsonObject.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogFaceTrackerBenchmark, Log, All);
+
+
+// Nearest-rank percentile of an ascending sample list
+static double GetPercentile(const TArray<double>& SortedSamples, double Percentile)
+{
+    if (SortedSamples.Num() == 0)
+    {
+        return 0.0;
+    }
+
+    const int32 Rank = FMath::CeilToInt(Percentile / 100.0 * SortedSamples.Num());
+    return SortedSamples[FMath::Clamp(Rank - 1, 0, SortedSamples.Num() - 1)];
+}
+
+// Intersection over union of two rects
+static float GetOverlap(const cv::Rect& A, const cv::Rect& B)
+{
+    const int32 Intersection = (A & B).area();
+    const int32 Union = A.area() + B.area() - Intersection;
+    return Union > 0 ? (float)Intersection / Union : 0.0f;
+}
+
+// CSV with one labelled face per line: frame,x,y,width,height in clip pixels, frames counted from 0.
+// The pipeline reports faces in the mirrored frame, so labels are mirrored to match
+static bool LoadGroundTruth(const FString& Path, int32 FrameWidth, TMap<int32, std::vector<cv::Rect>>& OutFaces)
+{
+    TArray<FString> Lines;
+    if (!FFileHelper::LoadFileToStringArray(Lines, *Path))
+    {
+        return false;
+    }
+
+    for (const FString& Line : Lines)
+    {
+        TArray<FString> Fields;
+        Line.ParseIntoArray(Fields, TEXT(","));
+        if (Fields.Num() != 5 || !Fields[0].IsNumeric())
+        {
+            // Header or blank line
+            continue;
+        }
+
+        const int32 X = FCString::Atoi(*Fields[1]);
+        const int32 Width = FCString::Atoi(*Fields[3]);
+        OutFaces.FindOrAdd(FCString::Atoi(*Fields[0])).push_back(cv::Rect(FrameWidth - X - Width, FCString::Atoi(*Fields[2]), Width, FCString::Atoi(*Fields[4])));
+    }
+
+    return true;
+}
+
+// FaceCenter as AFaceTracker publishes it
+static FVector2D GetFaceCenter(const cv::Rect& Face)
+{
+    return FVector2D(Face.x + Face.width / 2.0f, Face.y + Face.height / 2.0f);
+}
+
+// Run the clip through the pipeline and through a reference pipeline that flips every whole frame, side by side.
+// Returns the number of frames compared, OutMismatchedFrames counts frames whose FaceCenter or FaceSize differ
+static int32 CompareMirrorPaths(const FFaceFrameSourceSettings& SourceSettings, FFaceTrackerModels& Models, FIntPoint FrameSize,
+    const FFaceDetectionSettings& DetectionSettings, float TargetFrameRate, int32 MaxFrames, int32& OutMismatchedFrames)
+{
+    OutMismatchedFrames = 0;
+
+    TUniquePtr<IFaceFrameSource> Source = IFaceFrameSource::Create(SourceSettings, FrameSize, TargetFrameRate);
+    TUniquePtr<IFaceFrameSource> ReferenceSource = IFaceFrameSource::Create(SourceSettings, FrameSize, TargetFrameRate);
+    if (!Source->Open() || !ReferenceSource->Open())
+    {
+        return 0;
+    }
+
+    // The models are only used by one pipeline at a time
+    FVideoProcessingThread Pipeline(Source.Get(), &Models, FrameSize.X, FrameSize.Y, DetectionSettings, TargetFrameRate, false);
+    FVideoProcessingThread ReferencePipeline(ReferenceSource.Get(), &Models, FrameSize.X, FrameSize.Y, DetectionSettings, TargetFrameRate, false);
+    Pipeline.SetPreviewEnabled(false);
+    ReferencePipeline.SetPreviewEnabled(false);
+    ReferencePipeline.SetReferenceMirror(true);
+
+    int32 Frames = 0;
+    while ((MaxFrames <= 0 || Frames < MaxFrames) && Pipeline.ProcessFrame() && ReferencePipeline.ProcessFrame())
+    {
+        const std::vector<cv::Rect>& Faces = Pipeline.GetLastFaces();
+        const std::vector<cv::Rect>& ReferenceFaces = ReferencePipeline.GetLastFaces();
+
+        bool bMatch = Faces.size() == ReferenceFaces.size();
+        for (size_t FaceIndex = 0; bMatch && FaceIndex < Faces.size(); FaceIndex++)
+        {
+            bMatch = GetFaceCenter(Faces[FaceIndex]) == GetFaceCenter(ReferenceFaces[FaceIndex]) && Faces[FaceIndex].width == ReferenceFaces[FaceIndex].width;
+        }
+
+        if (!bMatch && OutMismatchedFrames++ < 10)
+        {
+            const FVector2D Center = Faces.size() > 0 ? GetFaceCenter(Faces[0]) : FVector2D::ZeroVector;
+            const FVector2D ReferenceCenter = ReferenceFaces.size() > 0 ? GetFaceCenter(ReferenceFaces[0]) : FVector2D::ZeroVector;
+            UE_LOG(LogFaceTrackerBenchmark, Warning, TEXT("Frame %d: %d faces, first at %s, reference %d faces, first at %s"),
+                Frames, (int32)Faces.size(), *Center.ToString(), (int32)ReferenceFaces.size(), *ReferenceCenter.ToString());
+        }
+        Frames++;
+    }
+
+    return Frames;
+}
+
+UFaceTrackerBenchmarkCommandlet::UFaceTrackerBenchmarkCommandlet()
+{
+    IsClient = false;
+    IsEditor = false;
+    IsServer = false;
+    LogToConsole = true;
+}
+
+int32 UFaceTrackerBenchmarkCommandlet::Main(const FString& Params)
+{
+    FString ClipPath;
+    if (!FParse::Value(*Params, TEXT("Clip="), ClipPath))
+    {
+        UE_LOG(LogFaceTrackerBenchmark, Error, TEXT("Usage: -run=FaceTrackerBenchmark -Clip=<video file or PNG folder> [-Output=<json>] [-Frames=<max frames>] [-Warmup=<frames>] [-DetectionMode=<mode>] [-Detectors=<backend,...>] [-GroundTruth=<csv>] [-Classifier=<backend>] [-CompareMirror]"));
+        return 1;
+    }
+
+    if (FPaths::IsRelative(ClipPath))
+    {
+        ClipPath = FPaths::ConvertRelativePathToFull(FPaths::ProjectDir(), ClipPath);
+    }
+
+    FString OutputPath = FPaths::ProjectSavedDir() / TEXT("Profiling/FaceTrackerBenchmark.json");
+    FParse::Value(*Params, TEXT("Output="), OutputPath);
+
+    int32 MaxFrames = 0;
+    FParse::Value(*Params, TEXT("Frames="), MaxFrames);
+
+    int32 WarmupFrames = 10;
+    FParse::Value(*Params, TEXT("Warmup="), WarmupFrames);
+
+    // Replay the clip once per detector, as fast as the pipeline allows
+    FFaceFrameSourceSettings SourceSettings;
+    SourceSettings.SourceType = IFileManager::Get().DirectoryExists(*ClipPath) ? EFaceFrameSourceType::ImageSequence : EFaceFrameSourceType::VideoFile;
+    SourceSettings.SourcePath = ClipPath;
+    SourceSettings.Pacing = EFaceFramePacing::AsFastAsPossible;
+    SourceSettings.bLoop = false;
+
+    const AFaceTracker* TrackerDefaults = GetDefault<AFaceTracker>();
+
+    // -DetectionMode=FullScan|DetectAndTrack|LocalSearch overrides the tracker's default mode
+    FFaceDetectionSettings DetectionSettings = TrackerDefaults->DetectionSettings;
+    FString DetectionModeName;
+    if (FParse::Value(*Params, TEXT("DetectionMode="), DetectionModeName))
+    {
+        const int64 DetectionMode = StaticEnum<EFaceDetectionMode>()->GetValueByNameString(DetectionModeName);
+        if (DetectionMode == INDEX_NONE)
+        {
+            UE_LOG(LogFaceTrackerBenchmark, Error, TEXT("Unknown detection mode %s"), *DetectionModeName);
+            return 1;
+        }
+        DetectionSettings.Mode = (EFaceDetectionMode)DetectionMode;
+    }
+
+    // -Detectors=HaarCascade,DnnSsd runs the clip through each face detector in turn for a side-by-side comparison
+    TArray<EFaceDetectorBackend> Backends;
+    FString DetectorNames;
+    if (FParse::Value(*Params, TEXT("Detectors="), DetectorNames, false))
+    {
+        TArray<FString> Names;
+        DetectorNames.ParseIntoArray(Names, TEXT(","));
+        for (const FString& Name : Names)
+        {
+            const int64 Backend = StaticEnum<EFaceDetectorBackend>()->GetValueByNameString(Name);
+            if (Backend == INDEX_NONE)
+            {
+                UE_LOG(LogFaceTrackerBenchmark, Error, TEXT("Unknown face detector %s"), *Name);
+                return 1;
+            }
+            Backends.Add((EFaceDetectorBackend)Backend);
+        }
+    }
+    if (Backends.Num() == 0)
+    {
+        Backends.Add(DetectionSettings.Backend);
+    }
+
+    // -Classifier=HaarFeatures|DnnFer overrides the tracker's emotion classifier
+    FEmotionClassifierSettings ClassifierSettings = TrackerDefaults->EmotionClassifier;
+    FString ClassifierName;
+    if (FParse::Value(*Params, TEXT("Classifier="), ClassifierName))
+    {
+        const int64 ClassifierBackend = StaticEnum<EEmotionClassifierBackend>()->GetValueByNameString(ClassifierName);
+        if (ClassifierBackend == INDEX_NONE)
+        {
+            UE_LOG(LogFaceTrackerBenchmark, Error, TEXT("Unknown emotion classifier %s"), *ClassifierName);
+            return 1;
+        }
+        ClassifierSettings.Backend = (EEmotionClassifierBackend)ClassifierBackend;
+    }
+
+    TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+    Report->SetStringField(TEXT("clip"), ClipPath);
+    Report->SetStringField(TEXT("classifier"), StaticEnum<EEmotionClassifierBackend>()->GetNameStringByValue((int64)ClassifierSettings.Backend));
+    Report->SetStringField(TEXT("detection_mode"), StaticEnum<EFaceDetectionMode>()->GetNameStringByValue((int64)DetectionSettings.Mode));
+
+    TSharedRef<FJsonObject> DetectorReports = MakeShared<FJsonObject>();
+    TMap<int32, std::vector<cv::Rect>> GroundTruth;
+    FString GroundTruthPath;
+    const bool bHasGroundTruth = FParse::Value(*Params, TEXT("GroundTruth="), GroundTruthPath);
+    const bool bCompareMirror = FParse::Param(*Params, TEXT("CompareMirror"));
+    bool bMirrorMismatch = false;
+
+    for (EFaceDetectorBackend Backend : Backends)
+    {
+        const FString BackendName = StaticEnum<EFaceDetectorBackend>()->GetNameStringByValue((int64)Backend);
+
+        TUniquePtr<IFaceFrameSource> FrameSource = IFaceFrameSource::Create(SourceSettings, FIntPoint(640, 480), 30.0f);
+        if (!FrameSource->Open())
+        {
+            UE_LOG(LogFaceTrackerBenchmark, Error, TEXT("Failed to open %s"), *FrameSource->GetDescription());
+            return 1;
+        }
+
+        const FIntPoint FrameSize = FrameSource->GetFrameSize();
+        Report->SetNumberField(TEXT("width"), FrameSize.X);
+        Report->SetNumberField(TEXT("height"), FrameSize.Y);
+
+        if (bHasGroundTruth && GroundTruth.Num() == 0 && !LoadGroundTruth(GroundTruthPath, FrameSize.X, GroundTruth))
+        {
+            UE_LOG(LogFaceTrackerBenchmark, Error, TEXT("Failed to read ground truth %s"), *GroundTruthPath);
+            return 1;
+        }
+
+        // Same models the tracker actor loads by default
+        FFaceDetectorConfig DetectorConfig = TrackerDefaults->GetDetectorConfig();
+        DetectorConfig.Backend = Backend;
+        FFaceTrackerModels Models;
+        if (!Models.Load(DetectorConfig, ClassifierSettings, TrackerDefaults->EyeCascadePath, TrackerDefaults->SmileCascadePath, TrackerDefaults->MaxParallelFaces))
+        {
+            UE_LOG(LogFaceTrackerBenchmark, Error, TEXT("Failed to load models for %s"), *BackendName);
+            return 1;
+        }
+
+        FFaceDetectionSettings BackendSettings = DetectionSettings;
+        BackendSettings.Backend = Backend;
+
+        int32 MirrorFrames = 0;
+        int32 MirrorMismatches = 0;
+        if (bCompareMirror)
+        {
+            MirrorFrames = CompareMirrorPaths(SourceSettings, Models, FrameSize, BackendSettings, TrackerDefaults->TargetFPS, MaxFrames, MirrorMismatches);
+            bMirrorMismatch |= MirrorFrames == 0 || MirrorMismatches > 0;
+            UE_LOG(LogFaceTrackerBenchmark, Display, TEXT("Mirror check: %d of %d frames differ from the reference"), MirrorMismatches, MirrorFrames);
+        }
+
+        FVideoProcessingThread Pipeline(FrameSource.Get(), &Models, FrameSize.X, FrameSize.Y, BackendSettings, TrackerDefaults->TargetFPS, false);
+
+        FFacePipelineTimings Timings;
+        Pipeline.SetTimings(&Timings);
+
+        // Warm up caches and allocations before measuring
+        int32 ClipFrame = 0;
+        for (; ClipFrame < WarmupFrames && Pipeline.ProcessFrame(); ClipFrame++)
+        {
+        }
+        Timings.Reset();
+
+        int32 FramesProcessed = 0;
+        int32 LabelledFaces = 0;
+        int32 FoundFaces = 0;
+        const double StartTime = FPlatformTime::Seconds();
+        while ((MaxFrames <= 0 || FramesProcessed < MaxFrames) && Pipeline.ProcessFrame())
+        {
+            // A labelled face counts as found if a detection overlaps it by at least half, each detection matches once
+            if (const std::vector<cv::Rect>* LabelledRects = GroundTruth.Find(ClipFrame))
+            {
+                std::vector<cv::Rect> Detections = Pipeline.GetLastFaces();
+                for (const cv::Rect& Labelled : *LabelledRects)
+                {
+                    LabelledFaces++;
+                    for (size_t DetectionIndex = 0; DetectionIndex < Detections.size(); DetectionIndex++)
+                    {
+                        if (GetOverlap(Labelled, Detections[DetectionIndex]) >= 0.5f)
+                        {
+                            FoundFaces++;
+                            Detections.erase(Detections.begin() + DetectionIndex);
+                            break;
+                        }
+                    }
+                }
+            }
+
+            FramesProcessed++;
+            ClipFrame++;
+        }
+        const double WallSeconds = FPlatformTime::Seconds() - StartTime;
+        const double FramesPerSecond = WallSeconds > 0.0 ? FramesProcessed / WallSeconds : 0.0;
+
+        if (FramesProcessed == 0)
+        {
+            UE_LOG(LogFaceTrackerBenchmark, Error, TEXT("No frames left to measure after %d warm-up frames"), WarmupFrames);
+            return 1;
+        }
+
+        UE_LOG(LogFaceTrackerBenchmark, Display, TEXT("%s, %s: %d frames at %dx%d, %.1f FPS"), *FrameSource->GetDescription(), *Models.FaceDetector->GetDescription(), FramesProcessed, FrameSize.X, FrameSize.Y, FramesPerSecond);
+
+        TSharedRef<FJsonObject> DetectorReport = MakeShared<FJsonObject>();
+        DetectorReport->SetStringField(TEXT("detector"), Models.FaceDetector->GetDescription());
+        DetectorReport->SetNumberField(TEXT("frames"), FramesProcessed);
+        DetectorReport->SetNumberField(TEXT("wall_seconds"), WallSeconds);
+        DetectorReport->SetNumberField(TEXT("fps"), FramesPerSecond);
+        DetectorReport->SetNumberField(TEXT("ms_per_frame"), WallSeconds * 1000.0 / FramesProcessed);
+
+        if (bCompareMirror)
+        {
+            DetectorReport->SetNumberField(TEXT("mirror_frames"), MirrorFrames);
+            DetectorReport->SetNumberField(TEXT("mirror_mismatched_frames"), MirrorMismatches);
+        }
+
+        if (LabelledFaces > 0)
+        {
+            const double Recall = (double)FoundFaces / LabelledFaces;
+            DetectorReport->SetNumberField(TEXT("labelled_faces"), LabelledFaces);
+            DetectorReport->SetNumberField(TEXT("recall"), Recall);
+            UE_LOG(LogFaceTrackerBenchmark, Display, TEXT("Recall %.3f (%d of %d labelled faces)"), Recall, FoundFaces, LabelledFaces);
+        }
+
+        // Includes warm-up frames
+        const FFaceDetectionStats DetectionStats = Pipeline.GetDetectionStats();
+        DetectorReport->SetNumberField(TEXT("scanned_pixels_per_frame"), DetectionStats.AverageScannedPixels);
+        DetectorReport->SetNumberField(TEXT("full_scans"), DetectionStats.FullScans);
+
+        TSharedRef<FJsonObject> StageReports = MakeShared<FJsonObject>();
+        for (int32 StageIndex = 0; StageIndex < (int32)EFacePipelineStage::Count; StageIndex++)
+        {
+            const EFacePipelineStage Stage = (EFacePipelineStage)StageIndex;
+
+            TArray<double> Samples = Timings.GetSamples(Stage);
+            if (Samples.Num() == 0)
+            {
+                continue;
+            }
+            Samples.Sort();
+
+            double Total = 0.0;
+            for (double Sample : Samples)
+            {
+                Total += Sample;
+            }
+
+            TSharedRef<FJsonObject> StageReport = MakeShared<FJsonObject>();
+            StageReport->SetNumberField(TEXT("count"), Samples.Num());
+            StageReport->SetNumberField(TEXT("mean_ms"), Total / Samples.Num());
+            StageReport->SetNumberField(TEXT("p50_ms"), GetPercentile(Samples, 50.0));
+            StageReport->SetNumberField(TEXT("p95_ms"), GetPercentile(Samples, 95.0));
+            StageReport->SetNumberField(TEXT("p99_ms"), GetPercentile(Samples, 99.0));
+            StageReport->SetNumberField(TEXT("max_ms"), Samples.Last());
+            StageReports->SetObjectField(GetFacePipelineStageName(Stage), StageReport);
+
+            UE_LOG(LogFaceTrackerBenchmark, Display, TEXT("%-12s n=%-6d p50 %8.3f ms   p95 %8.3f ms   p99 %8.3f ms"),
+                GetFacePipelineStageName(Stage), Samples.Num(), GetPercentile(Samples, 50.0), GetPercentile(Samples, 95.0), GetPercentile(Samples, 99.0));
+        }
+        DetectorReport->SetObjectField(TEXT("stages"), StageReports);
+
+        DetectorReports->SetObjectField(BackendName, DetectorReport);
+    }
+    Report->SetObjectField(TEXT("detectors"), DetectorReports);
+
+    FString ReportJson;
+    TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&ReportJson);
+    FJsonSerializer::Serialize(Report, Writer);
+
+    if (!FFileHelper::SaveStringToFile(ReportJson, *OutputPath))
+    {
+        UE_LOG(LogFaceTrackerBenchmark, Error, TEXT("Failed to write %s"), *OutputPath);
+        return 1;
+    }
+
+    UE_LOG(LogFaceTrackerBenchmark, Display, TEXT("Benchmark written to %s"), *OutputPath);
+
+    if (bMirrorMismatch)
+    {
+        UE_LOG(LogFaceTrackerBenchmark, Error, TEXT("Mirror check failed, the published faces differ from the reference pipeline"));
+        return 1;
+    }
+    return 0;
+}
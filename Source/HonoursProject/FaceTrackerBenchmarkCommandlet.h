@@ -0,0 +1,34 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "FaceTrackerBenchmarkCommandlet.generated.h"
+
+/**
+ *  Runs a recorded clip through the face pipeline without a camera or GPU
+ *  and writes per-stage latency percentiles to JSON. With -Detectors the clip is run once per
+ *  face detector, and with -GroundTruth each run also reports recall against labelled faces.
+ *  -CompareMirror also runs the clip through a reference pipeline that flips every whole frame, as the tracker
+ *  used to, and fails if any frame's published FaceCenter or FaceSize differs from the pipeline's.
+ *
+ *  UnrealEditor-Cmd HonoursProject.uproject -run=FaceTrackerBenchmark -Clip=<video or PNG folder>
+ *      [-Output=<json>] [-Frames=<max frames>] [-Warmup=<frames>] [-DetectionMode=<mode>]
+ *      [-Detectors=HaarCascade,DnnSsd] [-GroundTruth=<csv of frame,x,y,width,height>] [-Classifier=HaarFeatures|DnnFer]
+ *      [-CompareMirror]
+ *      -nullrhi -unattended
+ */
+UCLASS()
+class HONOURSPROJECT_API UFaceTrackerBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	/** Constructor */
+	UFaceTrackerBenchmarkCommandlet();
+
+	/** Commandlet entry point, returns non-zero on failure */
+	virtual int32 Main(const FString& Params) override;
+};
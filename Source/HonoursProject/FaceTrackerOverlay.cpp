@@ -0,0 +1,98 @@
+
+#include "FaceTrackerOverlay.h"
+#include "FaceTracker.h"
+#include "HAL/IConsoleManager.h"
+#include "Rendering/DrawElements.h"
+#include "Styling/CoreStyle.h"
+#include "Engine/Texture2D.h"
+
+
+static TAutoConsoleVariable<bool> CVarFaceTrackerOverlay(
+    TEXT("FaceTracker.Overlay"),
+    true,
+    TEXT("Draw face tracker overlays, the preview and the face boxes and emotion labels over it"));
+
+static FLinearColor GetEmotionColor(EFacialEmotion Emotion)
+{
+    switch (Emotion)
+    {
+        case EFacialEmotion::Happy:
+            return FLinearColor(FColor(0, 255, 0));
+        case EFacialEmotion::Sad:
+            return FLinearColor(FColor(0, 0, 255));
+        case EFacialEmotion::Angry:
+            return FLinearColor(FColor(255, 0, 0));
+        case EFacialEmotion::Surprised:
+            return FLinearColor(FColor(0, 255, 255));
+        case EFacialEmotion::Fearful:
+            return FLinearColor(FColor(255, 0, 255));
+        case EFacialEmotion::Disgusted:
+            return FLinearColor(FColor(128, 0, 128));
+        default:
+            return FLinearColor(FColor(128, 128, 128));
+    }
+}
+
+int32 UFaceTrackerOverlay::NativePaint(const FPaintArgs& Args, const FGeometry& AllottedGeometry, const FSlateRect& MyCullingRect,
+    FSlateWindowElementList& OutDrawElements, int32 LayerId, const FWidgetStyle& InWidgetStyle, bool bParentEnabled) const
+{
+    LayerId = Super::NativePaint(Args, AllottedGeometry, MyCullingRect, OutDrawElements, LayerId, InWidgetStyle, bParentEnabled);
+
+    if (!Tracker || !CVarFaceTrackerOverlay.GetValueOnGameThread() || Tracker->VideoWidth <= 0 || Tracker->VideoHeight <= 0)
+    {
+        return LayerId;
+    }
+
+    // Fit the video into the widget without stretching it, the boxes go in the same rect
+    const FVector2f LocalSize = AllottedGeometry.GetLocalSize();
+    const FVector2f FrameSize((float)Tracker->VideoWidth, (float)Tracker->VideoHeight);
+    const float FitScale = FMath::Min(LocalSize.X / FrameSize.X, LocalSize.Y / FrameSize.Y);
+    const FVector2f VideoSize = FrameSize * FitScale;
+    const FGeometry VideoGeometry = AllottedGeometry.MakeChild(VideoSize, FSlateLayoutTransform((LocalSize - VideoSize) * 0.5f));
+
+    // VideoTexture is uploaded unmirrored, flip it about the centre of its rect like the video material does
+    UTexture2D* VideoTexture = Tracker->GetVideoTexture();
+    if (bDrawVideo && VideoTexture)
+    {
+        VideoBrush.SetResourceObject(VideoTexture);
+        VideoBrush.ImageSize = FrameSize;
+        const FGeometry MirroredGeometry = VideoGeometry.MakeChild(FSlateRenderTransform(FScale2f(-1.0f, 1.0f)), FVector2f(0.5f, 0.5f));
+        LayerId++;
+        FSlateDrawElement::MakeBox(OutDrawElements, LayerId, MirroredGeometry.ToPaintGeometry(), &VideoBrush, ESlateDrawEffect::None,
+            InWidgetStyle.GetColorAndOpacityTint());
+    }
+
+    // Face boxes are in the mirrored video frame, which is how the preview shows it
+    const FVector2f Scale(FitScale, FitScale);
+    const FSlateFontInfo LabelFont = FCoreStyle::GetDefaultFontStyle("Regular", FontSize);
+    const FSlateFontInfo ConfidenceFont = FCoreStyle::GetDefaultFontStyle("Regular", FMath::Max(FontSize * 2 / 3, 6));
+    const FVector2f TextSize(VideoSize.X, FontSize * 2.0f);
+
+    LayerId++;
+    TArray<FVector2f> BoxPoints;
+    BoxPoints.SetNum(5);
+    for (const FFacialEmotionData& Face : Tracker->GetDetectedEmotions())
+    {
+        const FVector2f Min = FVector2f(Face.FaceBox.Min) * Scale;
+        const FVector2f Max = FVector2f(Face.FaceBox.Max) * Scale;
+        const FLinearColor Color = GetEmotionColor(Face.Emotion);
+
+        BoxPoints[0] = Min;
+        BoxPoints[1] = FVector2f(Max.X, Min.Y);
+        BoxPoints[2] = Max;
+        BoxPoints[3] = FVector2f(Min.X, Max.Y);
+        BoxPoints[4] = Min;
+        FSlateDrawElement::MakeLines(OutDrawElements, LayerId, VideoGeometry.ToPaintGeometry(), BoxPoints, ESlateDrawEffect::None, Color, true, BoxThickness);
+
+        // Label above the box, confidence below it
+        const FString Label = FString::Printf(TEXT("#%d %s"), Face.FaceId, *StaticEnum<EFacialEmotion>()->GetDisplayNameTextByValue((int64)Face.Emotion).ToString());
+        FSlateDrawElement::MakeText(OutDrawElements, LayerId, VideoGeometry.ToPaintGeometry(TextSize, FSlateLayoutTransform(FVector2f(Min.X, Min.Y - FontSize * 1.5f))),
+            Label, LabelFont, ESlateDrawEffect::None, Color);
+
+        const FString Confidence = FString::Printf(TEXT("Conf: %d%%"), (int32)(Face.Confidence * 100));
+        FSlateDrawElement::MakeText(OutDrawElements, LayerId, VideoGeometry.ToPaintGeometry(TextSize, FSlateLayoutTransform(FVector2f(Min.X, Max.Y + BoxThickness))),
+            Confidence, ConfidenceFont, ESlateDrawEffect::None, Color);
+    }
+
+    return LayerId;
+}
@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Blueprint/UserWidget.h"
+
+#include "FaceTrackerOverlay.generated.h"
+
+class AFaceTracker;
+
+
+// Draws a tracker's preview, mirrored and fitted to the widget with its aspect ratio kept, with the face boxes,
+// emotion labels and confidences of the latest results over it. The boxes are laid out in the same rect as the
+// video, so they line up wherever and at whatever size the widget is placed.
+// The video frame itself is never drawn into.
+// Toggle it with AFaceTracker::SetOverlayVisible, the widget's visibility or FaceTracker.Overlay
+UCLASS()
+class HONOURSPROJECT_API UFaceTrackerOverlay : public UUserWidget
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(BlueprintReadWrite, Category = "Facial Tracking", meta = (ExposeOnSpawn = true))
+	AFaceTracker* Tracker = nullptr;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Facial Tracking", meta = (ClampMin = 1))
+	float BoxThickness = 3.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Facial Tracking", meta = (ClampMin = 6))
+	int32 FontSize = 14;
+
+	// Draw the tracker's video under the boxes. Clear it when the widget sits over a preview drawn elsewhere
+	// with the same rect and aspect ratio
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Facial Tracking")
+	bool bDrawVideo = true;
+
+protected:
+	virtual int32 NativePaint(const FPaintArgs& Args, const FGeometry& AllottedGeometry, const FSlateRect& MyCullingRect,
+		FSlateWindowElementList& OutDrawElements, int32 LayerId, const FWidgetStyle& InWidgetStyle, bool bParentEnabled) const override;
+
+private:
+	// Pointed at the tracker's video texture on every paint, as the tracker replaces it if the camera reconnects at another size
+	mutable FSlateBrush VideoBrush;
+};
@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include <atomic>
+
+// Lock-free single producer / single consumer triple buffer.
+// The producer fills its write slot and publishes it, the consumer picks up the
+// latest published slot. Neither side blocks and the payload is never copied.
+template<typename T>
+class TFaceTripleBuffer
+{
+public:
+	TFaceTripleBuffer()
+		: SharedState(1)
+		, WriteIndex(0)
+		, ReadIndex(2)
+	{
+	}
+
+	// Producer: slot to fill before calling Publish()
+	T& GetWriteSlot()
+	{
+		return Slots[WriteIndex];
+	}
+
+	// Producer: make the write slot the latest value and take over the spare slot
+	void Publish()
+	{
+		const uint8 Previous = SharedState.exchange(WriteIndex | FreshFlag, std::memory_order_acq_rel);
+		WriteIndex = Previous & IndexMask;
+	}
+
+	// Consumer: latest published slot, or nullptr if nothing was published since the last call.
+	// The returned slot is not touched by the producer until the next call.
+	T* ConsumeLatest()
+	{
+		if ((SharedState.load(std::memory_order_acquire) & FreshFlag) == 0)
+		{
+			return nullptr;
+		}
+
+		const uint8 Previous = SharedState.exchange(ReadIndex, std::memory_order_acq_rel);
+		ReadIndex = Previous & IndexMask;
+		return &Slots[ReadIndex];
+	}
+
+private:
+	static constexpr uint8 IndexMask = 0x3;
+	static constexpr uint8 FreshFlag = 0x4;
+
+	T Slots[3] = {};
+
+	// Index of the spare slot, plus FreshFlag while it holds data the consumer hasn't seen
+	std::atomic<uint8> SharedState;
+
+	// Owned by the producer
+	uint8 WriteIndex;
+
+	// Owned by the consumer
+	uint8 ReadIndex;
+};
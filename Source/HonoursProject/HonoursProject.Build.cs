@@ -9,6 +9,9 @@ public class HonoursProject : ModuleRules
 	{
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
+		// OpenCV reports corrupt or unsupported DNN models by throwing cv::Exception, see LoadDnnNet
+		bEnableExceptions = true;
+
 		PublicDependencyModuleNames.AddRange(new string[] {
 			"Core",
 			"CoreUObject",
@@ -25,7 +28,7 @@ public class HonoursProject : ModuleRules
 			"MediaIOCore"
 		});
 
-		PrivateDependencyModuleNames.AddRange(new string[] { "Media", "MediaIOCore" });
+		PrivateDependencyModuleNames.AddRange(new string[] { "Media", "MediaIOCore", "RenderCore", "Json", "SlateCore" });
 
 		PublicIncludePaths.AddRange(new string[] {
 			"HonoursProject",
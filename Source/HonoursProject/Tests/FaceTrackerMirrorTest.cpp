@@ -0,0 +1,166 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+#include "FaceTracker.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+// Hands out the same frame on every read, in one capture format
+class FFixedFaceFrameSource : public IFaceFrameSource
+{
+public:
+	FFixedFaceFrameSource(const cv::Mat& InFrame, EFaceFrameFormat InFormat, FIntPoint InFrameSize)
+	: Frame(InFrame)
+	, Format(InFormat)
+	, FrameSize(InFrameSize)
+	{
+	}
+
+	virtual bool Open() override { return true; }
+	virtual void Close() override {}
+	virtual bool IsOpen() const override { return true; }
+	// Shared like a webcam subscription's frames, the pipeline must never write to it
+	virtual bool ReadFrame(cv::Mat& OutFrame) override { OutFrame = Frame; return true; }
+	virtual int32 DropStaleFrames(int32 MaxFrames) override { return 0; }
+	virtual double GetFrameTime() const override { return 0.0; }
+	virtual FIntPoint GetFrameSize() const override { return FrameSize; }
+	virtual float GetFrameRate() const override { return 30.0f; }
+	virtual EFaceFrameFormat GetFrameFormat() const override { return Format; }
+	virtual FString GetDescription() const override { return TEXT("Fixed test frame"); }
+
+private:
+	cv::Mat Frame;
+	EFaceFrameFormat Format;
+	FIntPoint FrameSize;
+};
+
+// A cartoon face left of centre that the default Haar face cascade finds at every tested detection scale
+static cv::Mat DrawTestFace()
+{
+	cv::Mat Image(480, 640, CV_8UC3, cv::Scalar(90, 110, 100));
+	const cv::Point Center(300, 230);
+	cv::ellipse(Image, Center, cv::Size(80, 105), 0, 0, 360, cv::Scalar(150, 175, 210), -1);
+	cv::ellipse(Image, Center + cv::Point(0, -95), cv::Size(85, 40), 0, 180, 360, cv::Scalar(40, 40, 50), -1);
+	for (int32 EyeOffset : { -32, 32 })
+	{
+		cv::ellipse(Image, Center + cv::Point(EyeOffset, -30), cv::Size(20, 6), 0, 180, 360, cv::Scalar(60, 60, 70), 4);
+		cv::ellipse(Image, Center + cv::Point(EyeOffset, -10), cv::Size(16, 9), 0, 0, 360, cv::Scalar(240, 240, 240), -1);
+		cv::circle(Image, Center + cv::Point(EyeOffset, -10), 6, cv::Scalar(40, 30, 20), -1);
+	}
+	cv::line(Image, Center + cv::Point(0, -5), Center + cv::Point(-6, 30), cv::Scalar(110, 130, 170), 4);
+	cv::ellipse(Image, Center + cv::Point(-5, 32), cv::Size(14, 6), 0, 0, 360, cv::Scalar(120, 140, 180), -1);
+	cv::ellipse(Image, Center + cv::Point(0, 55), cv::Size(30, 10), 0, 0, 180, cv::Scalar(60, 60, 150), 5);
+	cv::GaussianBlur(Image, Image, cv::Size(0, 0), 2.0);
+	return Image;
+}
+
+// The test face in each capture format the pipeline reads
+static cv::Mat EncodeTestFace(const cv::Mat& Image, EFaceFrameFormat Format)
+{
+	cv::Mat Gray;
+	cv::cvtColor(Image, Gray, cv::COLOR_BGR2GRAY);
+
+	switch (Format)
+	{
+		case EFaceFrameFormat::Grey:
+			return Gray;
+		case EFaceFrameFormat::Yuyv:
+		{
+			cv::Mat Yuyv;
+			const cv::Mat Chroma(Gray.size(), CV_8UC1, cv::Scalar(128));
+			cv::merge(std::vector<cv::Mat>{ Gray, Chroma }, Yuyv);
+			return Yuyv;
+		}
+		case EFaceFrameFormat::Mjpeg:
+		{
+			std::vector<uchar> Jpeg;
+			cv::imencode(".jpg", Image, Jpeg);
+			return cv::Mat(1, (int32)Jpeg.size(), CV_8UC1, Jpeg.data()).clone();
+		}
+		default:
+			return Image;
+	}
+}
+
+static FVector2D GetFaceCenter(const cv::Rect& Face)
+{
+	return FVector2D(Face.x + Face.width / 2.0f, Face.y + Face.height / 2.0f);
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FFaceTrackerMirrorTest, "HonoursProject.FaceTracker.Mirror",
+	EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+// Mirroring only the luma frame must publish the same FaceCenter and FaceSize as flipping every captured frame
+bool FFaceTrackerMirrorTest::RunTest(const FString& Parameters)
+{
+	const AFaceTracker* TrackerDefaults = GetDefault<AFaceTracker>();
+	FFaceDetectorConfig DetectorConfig = TrackerDefaults->GetDetectorConfig();
+	DetectorConfig.Backend = EFaceDetectorBackend::HaarCascade;
+	FFaceTrackerModels Models;
+	if (!TestTrue(TEXT("Haar models load"), Models.Load(DetectorConfig, FEmotionClassifierSettings(), TrackerDefaults->EyeCascadePath, TrackerDefaults->SmileCascadePath, 1)))
+	{
+		return false;
+	}
+
+	FFaceDetectionSettings DetectionSettings;
+	DetectionSettings.Mode = EFaceDetectionMode::FullScan;
+
+	const cv::Mat Image = DrawTestFace();
+	const FIntPoint FrameSize(Image.cols, Image.rows);
+	const cv::Mat Original = Image.clone();
+
+	// 0.43 is a scale at which flipping after the resize differs from flipping before it
+	for (float DetectionScale : { 0.375f, 0.43f, 0.5f, 0.75f })
+	{
+		FFaceQualityLevel Quality;
+		Quality.DetectionScale = DetectionScale;
+
+		for (EFaceFrameFormat Format : { EFaceFrameFormat::Bgr, EFaceFrameFormat::Grey, EFaceFrameFormat::Yuyv, EFaceFrameFormat::Mjpeg })
+		{
+			const FString Case = FString::Printf(TEXT("format %d at scale %.3f"), (int32)Format, DetectionScale);
+			const cv::Mat Frame = EncodeTestFace(Image, Format);
+			FFixedFaceFrameSource Source(Frame, Format, FrameSize);
+			FFixedFaceFrameSource ReferenceSource(Frame, Format, FrameSize);
+
+			FVideoProcessingThread Pipeline(&Source, &Models, FrameSize.X, FrameSize.Y, DetectionSettings, 30.0f, false);
+			FVideoProcessingThread ReferencePipeline(&ReferenceSource, &Models, FrameSize.X, FrameSize.Y, DetectionSettings, 30.0f, false);
+			Pipeline.SetPreviewEnabled(false);
+			ReferencePipeline.SetPreviewEnabled(false);
+			ReferencePipeline.SetReferenceMirror(true);
+			Pipeline.SetQuality(Quality);
+			ReferencePipeline.SetQuality(Quality);
+
+			if (!TestTrue(*FString::Printf(TEXT("Frame processed, %s"), *Case), Pipeline.ProcessFrame() && ReferencePipeline.ProcessFrame()))
+			{
+				continue;
+			}
+
+			// Equal detection pixels are what makes the faces equal for any detector
+			const cv::Mat& DetectionFrame = Pipeline.GetLastDetectionFrame();
+			const cv::Mat& ReferenceDetectionFrame = ReferencePipeline.GetLastDetectionFrame();
+			TestTrue(*FString::Printf(TEXT("Detection frames are identical, %s"), *Case), DetectionFrame.size() == ReferenceDetectionFrame.size()
+				&& cv::countNonZero(DetectionFrame != ReferenceDetectionFrame) == 0);
+
+			const std::vector<cv::Rect>& Faces = Pipeline.GetLastFaces();
+			const std::vector<cv::Rect>& ReferenceFaces = ReferencePipeline.GetLastFaces();
+			if (!TestEqual(*FString::Printf(TEXT("Face count, %s"), *Case), (int32)Faces.size(), (int32)ReferenceFaces.size())
+				|| !TestEqual(*FString::Printf(TEXT("One face found, %s"), *Case), (int32)Faces.size(), 1))
+			{
+				continue;
+			}
+
+			const FVector2D Center = GetFaceCenter(Faces[0]);
+			const FVector2D ReferenceCenter = GetFaceCenter(ReferenceFaces[0]);
+			TestTrue(*FString::Printf(TEXT("FaceCenter %s matches %s, %s"), *Center.ToString(), *ReferenceCenter.ToString(), *Case), Center == ReferenceCenter);
+			TestEqual(*FString::Printf(TEXT("FaceSize, %s"), *Case), Faces[0].width, ReferenceFaces[0].width);
+
+			// The face is drawn left of centre, so the mirrored one is right of it
+			TestTrue(*FString::Printf(TEXT("Face is mirrored, %s"), *Case), Center.X > FrameSize.X / 2.0f);
+		}
+	}
+
+	TestTrue(TEXT("Captured frame left untouched"), cv::countNonZero(cv::Mat(Original != Image).reshape(1)) == 0);
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS